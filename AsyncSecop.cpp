@@ -0,0 +1,500 @@
+#include "AsyncSecop.h"
+
+#include <libutils/Exceptions.h>
+#include <libutils/Logger.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <cstring>
+
+using namespace Utils;
+
+namespace OPI
+{
+
+static inline bool reply_ok(const Json::Value& rep)
+{
+	return rep.isMember("status") && rep["status"].isObject() && rep["status"]["value"].asInt() == 0;
+}
+
+static inline exception_ptr reply_error(const Json::Value& rep)
+{
+	if( rep.isMember("status") && rep["status"].isMember("desc") && rep["status"]["desc"].isString() )
+	{
+		return make_exception_ptr( std::runtime_error( rep["status"]["desc"].asString() ) );
+	}
+
+	return make_exception_ptr( std::runtime_error("Internal error") );
+}
+
+static inline vector<string> reply_list(const Json::Value& list)
+{
+	vector<string> ret;
+
+	for(const auto& x: list)
+	{
+		ret.push_back( x.asString() );
+	}
+
+	return ret;
+}
+
+/* Exceptions escaping a callback on the loop thread would terminate */
+static void complete(const AsyncSecop::Callback& cb, const Json::Value& rep)
+{
+	try
+	{
+		cb( rep );
+	}
+	catch( std::exception& err )
+	{
+		logg << Logger::Error << "Secop callback failed: " << err.what() << lend;
+	}
+	catch( ... )
+	{
+		logg << Logger::Error << "Secop callback failed" << lend;
+	}
+}
+
+AsyncSecop::AsyncSecop(const string &path):
+	sock(-1), epfd(-1), evfd(-1), running(true), tid(0), pollout(false)
+{
+	struct sockaddr_un addr = {};
+
+	if( path.size() >= sizeof(addr.sun_path) )
+	{
+		throw std::runtime_error("Secop socket path too long");
+	}
+
+	addr.sun_family = AF_UNIX;
+	strncpy( addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1 );
+
+	if( ( this->sock = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) < 0 )
+	{
+		throw ErrnoException("Failed to create secop socket");
+	}
+
+	if( connect( this->sock, (struct sockaddr*) &addr, sizeof(addr) ) < 0 )
+	{
+		close( this->sock );
+		throw ErrnoException("Failed to connect to secop");
+	}
+
+	fcntl( this->sock, F_SETFL, fcntl( this->sock, F_GETFL ) | O_NONBLOCK );
+
+	this->evfd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	this->epfd = epoll_create1( EPOLL_CLOEXEC );
+
+	struct epoll_event sev = {}, eev = {};
+	sev.events = EPOLLIN;
+	sev.data.fd = this->sock;
+	eev.events = EPOLLIN;
+	eev.data.fd = this->evfd;
+
+	if( this->evfd < 0 || this->epfd < 0 ||
+			epoll_ctl( this->epfd, EPOLL_CTL_ADD, this->sock, &sev ) < 0 ||
+			epoll_ctl( this->epfd, EPOLL_CTL_ADD, this->evfd, &eev ) < 0 )
+	{
+		ErrnoException err("Failed to setup secop event loop");
+		close( this->sock );
+		if( this->evfd >= 0 )
+		{
+			close( this->evfd );
+		}
+		if( this->epfd >= 0 )
+		{
+			close( this->epfd );
+		}
+		throw err;
+	}
+
+	try
+	{
+		this->loop = thread( &AsyncSecop::Loop, this );
+	}
+	catch( ... )
+	{
+		// Destructor is not run for a partially constructed object
+		close( this->sock );
+		close( this->evfd );
+		close( this->epfd );
+		throw;
+	}
+}
+
+void AsyncSecop::Call(const Json::Value &cmd, AsyncSecop::Callback cb)
+{
+	Json::Value c = cmd;
+
+	{
+		lock_guard<mutex> lock(this->lock);
+
+		if( this->running )
+		{
+			c["tid"]=this->tid;
+			c["version"]=1.0;
+
+			this->pending[this->tid++] = cb;
+			this->outbuf += this->writer.write( c );
+
+			cb = nullptr;
+		}
+	}
+
+	if( cb )
+	{
+		// Event loop not running, fail directly
+		cb( Json::Value() );
+		return;
+	}
+
+	this->Wakeup();
+}
+
+future<Json::Value> AsyncSecop::Call(const Json::Value &cmd)
+{
+	auto p = make_shared<promise<Json::Value>>();
+
+	this->Call( cmd, [p](const Json::Value& rep)
+	{
+		p->set_value( rep );
+	});
+
+	return p->get_future();
+}
+
+future<bool> AsyncSecop::SockAuth()
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]= "auth";
+	cmd["type"]="socket";
+
+	auto p = make_shared<promise<bool>>();
+
+	this->Call( cmd, [p](const Json::Value& rep)
+	{
+		p->set_value( reply_ok( rep ) );
+	});
+
+	return p->get_future();
+}
+
+future<bool> AsyncSecop::HasACL(const string &user, const string &service, const string &acl)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]			= "hasacl";
+	cmd["username"]		= user;
+	cmd["servicename"]	= service;
+	cmd["acl"]			= acl;
+
+	auto p = make_shared<promise<bool>>();
+
+	this->Call( cmd, [p](const Json::Value& rep)
+	{
+		if( reply_ok( rep ) )
+		{
+			p->set_value( rep["hasacl"].asBool() );
+		}
+		else
+		{
+			p->set_exception( reply_error( rep ) );
+		}
+	});
+
+	return p->get_future();
+}
+
+future<bool> AsyncSecop::AppHasACL(const string &appid, const string &acl)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]			= "hasappacl";
+	cmd["appid"]		= appid;
+	cmd["acl"]			= acl;
+
+	auto p = make_shared<promise<bool>>();
+
+	this->Call( cmd, [p](const Json::Value& rep)
+	{
+		if( reply_ok( rep ) )
+		{
+			p->set_value( rep["hasacl"].asBool() );
+		}
+		else
+		{
+			p->set_exception( reply_error( rep ) );
+		}
+	});
+
+	return p->get_future();
+}
+
+future<vector<string>> AsyncSecop::GetUserGroups(const string &user)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]		= "getusergroups";
+	cmd["username"]	= user;
+
+	auto p = make_shared<promise<vector<string>>>();
+
+	this->Call( cmd, [p](const Json::Value& rep)
+	{
+		if( reply_ok( rep ) )
+		{
+			p->set_value( reply_list( rep["groups"] ) );
+		}
+		else
+		{
+			p->set_exception( reply_error( rep ) );
+		}
+	});
+
+	return p->get_future();
+}
+
+future<vector<string>> AsyncSecop::GetGroupMembers(const string &group)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]	= "groupgetmembers";
+	cmd["group"]= group;
+
+	auto p = make_shared<promise<vector<string>>>();
+
+	this->Call( cmd, [p](const Json::Value& rep)
+	{
+		if( reply_ok( rep ) )
+		{
+			p->set_value( reply_list( rep["members"] ) );
+		}
+		else
+		{
+			p->set_exception( reply_error( rep ) );
+		}
+	});
+
+	return p->get_future();
+}
+
+size_t AsyncSecop::Pending()
+{
+	lock_guard<mutex> lock(this->lock);
+
+	return this->pending.size();
+}
+
+AsyncSecop::~AsyncSecop()
+{
+	{
+		lock_guard<mutex> lock(this->lock);
+		this->running = false;
+	}
+
+	this->Wakeup();
+
+	if( this->loop.joinable() )
+	{
+		this->loop.join();
+	}
+
+	close( this->epfd );
+	close( this->evfd );
+	close( this->sock );
+}
+
+void AsyncSecop::Loop()
+{
+	struct epoll_event events[4];
+
+	while( true )
+	{
+		int n = epoll_wait( this->epfd, events, 4, -1 );
+
+		if( n < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			logg << Logger::Error << "Secop event loop failed: " << strerror(errno) << lend;
+			break;
+		}
+
+		bool ok = true;
+		for( int i = 0; i < n; i++ )
+		{
+			if( events[i].data.fd == this->evfd )
+			{
+				uint64_t val;
+				if( read( this->evfd, &val, sizeof(val) ) < 0 && errno != EAGAIN )
+				{
+					logg << Logger::Error << "Failed to read secop wakeup event" << lend;
+				}
+			}
+			else if( events[i].events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) )
+			{
+				ok = this->Receive() && ok;
+			}
+		}
+
+		{
+			lock_guard<mutex> lock(this->lock);
+			if( ! this->running )
+			{
+				break;
+			}
+		}
+
+		if( ! ( ok && this->Flush() ) )
+		{
+			logg << Logger::Error << "Lost connection to secop" << lend;
+			break;
+		}
+	}
+
+	this->FailAll();
+}
+
+void AsyncSecop::Wakeup()
+{
+	uint64_t val = 1;
+
+	if( write( this->evfd, &val, sizeof(val) ) < 0 && errno != EAGAIN )
+	{
+		logg << Logger::Error << "Failed to wake secop event loop" << lend;
+	}
+}
+
+bool AsyncSecop::Flush()
+{
+	lock_guard<mutex> lock(this->lock);
+
+	size_t written = 0;
+	while( written < this->outbuf.size() )
+	{
+		ssize_t wr = send( this->sock, this->outbuf.c_str() + written,
+						   this->outbuf.size() - written, MSG_NOSIGNAL );
+		if( wr < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			if( errno == EAGAIN || errno == EWOULDBLOCK )
+			{
+				break;
+			}
+			return false;
+		}
+		written += wr;
+	}
+	this->outbuf.erase( 0, written );
+
+	// Only poll for writability while we have data queued
+	bool want = this->outbuf.size() > 0;
+	if( want != this->pollout )
+	{
+		struct epoll_event ev = {};
+		ev.events = want ? EPOLLIN | EPOLLOUT : EPOLLIN;
+		ev.data.fd = this->sock;
+
+		if( epoll_ctl( this->epfd, EPOLL_CTL_MOD, this->sock, &ev ) < 0 )
+		{
+			return false;
+		}
+		this->pollout = want;
+	}
+
+	return true;
+}
+
+bool AsyncSecop::Receive()
+{
+	bool connected = true;
+
+	while( true )
+	{
+		char* buf = this->framer.Reserve( 4096 );
+		ssize_t rd = read( this->sock, buf, this->framer.Space() );
+
+		if( rd < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			connected = ( errno == EAGAIN || errno == EWOULDBLOCK );
+			break;
+		}
+		else if( rd == 0 )
+		{
+			connected = false;
+			break;
+		}
+		this->framer.Commit( rd );
+	}
+
+	const char *start, *end;
+	while( this->framer.Next( start, end ) )
+	{
+		Json::Value resp;
+		bool parsed = this->reader.parse( start, end, resp );
+		this->framer.Consume();
+
+		if( ! parsed || ! resp.isMember("tid") || ! resp["tid"].isInt() )
+		{
+			logg << Logger::Error << "Failed to parse secop response"<<lend;
+			continue;
+		}
+
+		Callback cb;
+		{
+			lock_guard<mutex> lock(this->lock);
+			auto it = this->pending.find( resp["tid"].asInt() );
+			if( it != this->pending.end() )
+			{
+				cb = it->second;
+				this->pending.erase( it );
+			}
+		}
+
+		if( cb )
+		{
+			complete( cb, resp );
+		}
+	}
+
+	if( this->framer.Failed() )
+	{
+		logg << Logger::Error << "Invalid message frame from secop" << lend;
+		connected = false;
+	}
+
+	return connected;
+}
+
+void AsyncSecop::FailAll()
+{
+	map<int, Callback> failed;
+
+	{
+		lock_guard<mutex> lock(this->lock);
+		this->running = false;
+		this->pending.swap( failed );
+	}
+
+	for( auto& cb: failed )
+	{
+		complete( cb.second, Json::Value() );
+	}
+}
+
+} // End NS
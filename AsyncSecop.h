@@ -0,0 +1,80 @@
+#ifndef ASYNCSECOP_H
+#define ASYNCSECOP_H
+
+#include <libutils/ClassTools.h>
+#include <json/json.h>
+
+#include "JsonHelper.h"
+#include "Secop.h"
+
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <map>
+
+using namespace std;
+
+namespace OPI
+{
+
+/*
+ * Asynchronous secop client.
+ *
+ * Commands are queued from any thread and written by an epoll driven
+ * event loop thread. Replies complete out of order, matched by tid.
+ * Callbacks are invoked on the event loop thread and should not block,
+ * exceptions thrown by them are logged and dropped.
+ */
+class AsyncSecop: public Utils::NoCopy
+{
+public:
+	typedef function<void(const Json::Value& reply)> Callback;
+
+	AsyncSecop(const string& path = SECOP_SOCKET);
+
+	void Call(const Json::Value& cmd, Callback cb);
+	future<Json::Value> Call(const Json::Value& cmd);
+
+	future<bool> SockAuth();
+
+	future<bool> HasACL(const string& user, const string& service, const string& acl);
+	future<bool> AppHasACL(const string& appid, const string& acl);
+	future<vector<string>> GetUserGroups(const string& user);
+	future<vector<string>> GetGroupMembers(const string& group);
+
+	/* Number of commands waiting for reply */
+	size_t Pending();
+
+	virtual ~AsyncSecop();
+private:
+	void Loop();
+	void Wakeup();
+	bool Flush();
+	bool Receive();
+	void FailAll();
+
+	int sock;
+	int epfd;
+	int evfd;
+	bool running;
+
+	mutex lock;
+	int tid;
+	string outbuf;
+	map<int, Callback> pending;
+	Json::FastWriter writer;
+
+	// Only used from event loop
+	JsonHelper::StreamFramer framer;
+	Json::Reader reader;
+	bool pollout;
+
+	thread loop;
+};
+
+} // End NS
+
+#endif // ASYNCSECOP_H
@@ -2,6 +2,9 @@
 #include "Secop.h"
 #include <stdexcept>
 #include <utility>
+#include <mutex>
+
+#include <crypto++/sha.h>
 
 #include <libutils/FileUtils.h>
 #include <libutils/HttpStatusCodes.h>
@@ -199,14 +202,13 @@ tuple<int, Json::Value> AuthServer::CheckMXPointer(const string &name)
 
 void AuthServer::Setup()
 {
-	Secop s;
+	SecopPtr s = SecopPool::Instance().Get();
 
-	s.SockAuth();
 	list<map<string,string>> ids;
 
 	try
 	{
-		ids = s.AppGetIdentifiers("op-backend");
+		ids = s->AppGetIdentifiers("op-backend");
 	}
 	catch( __attribute__((unused)) runtime_error& err )
 	{
@@ -215,30 +217,51 @@ void AuthServer::Setup()
 
 	if( ids.size() == 0 )
 	{
-		s.AppAddID("op-backend");
+		s->AppAddID("op-backend");
 
-		RSAWrapper ob;
-		ob.GenerateKeys();
+		// Instant if the application has reserved keys in the pool
+		RSAWrapperPtr ob = RSAKeyPool::Instance().Get();
 
 		// Write to secop
 		map<string,string> data;
 
 		data["type"] = "backendkeys";
-		data["pubkey"] = Base64Encode(ob.GetPubKeyAsDER());
-		data["privkey"] = Base64Encode(ob.GetPrivKeyAsDER());
-		s.AppAddIdentifier("op-backend", data);
+		data["pubkey"] = Base64Encode(ob->GetPubKeyAsDER());
+		data["privkey"] = Base64Encode(ob->GetPrivKeyAsDER());
+		s->AppAddIdentifier("op-backend", data);
 	}
 
 }
 
+/*
+ * Validated backend keys, keyed by hash of secop identifier content
+ * to avoid decoding and validating keys on every login. Every caller
+ * gets a wrapper of its own, loaded from the cached DER.
+ */
+static mutex keycache_lock;
+static string keycache_hash;
+static SecVector<byte> keycache_priv;
+static vector<byte> keycache_pub;
+
+static string identifier_hash(const string& privkey, const string& pubkey)
+{
+	SHA256 hash;
+	string digest( SHA256::DIGESTSIZE, '\0' );
+
+	hash.Update( (const byte*) privkey.c_str(), privkey.size() + 1 );
+	hash.Update( (const byte*) pubkey.c_str(), pubkey.size() );
+	hash.Final( (byte*) &digest[0] );
+
+	return digest;
+}
+
 RSAWrapperPtr AuthServer::GetKeysFromSecop()
 {
 	CryptoHelper::RSAWrapperPtr c;
 
-	Secop secop;
-	secop.SockAuth();
+	SecopPtr secop = SecopPool::Instance().Get();
 
-	list<map<string,string>> ids =  secop.AppGetIdentifiers("op-backend");
+	list<map<string,string>> ids =  secop->AppGetIdentifiers("op-backend");
 
 	if( ids.size() == 0 )
 	{
@@ -251,10 +274,42 @@ RSAWrapperPtr AuthServer::GetKeysFromSecop()
 		{
 			if( id["type"] == "backendkeys" )
 			{
+				string hash = identifier_hash( id["privkey"], id["pubkey"] );
+				SecVector<byte> priv;
+				vector<byte> pub;
+				bool cached = false;
+
+				{
+					lock_guard<mutex> lock(keycache_lock);
+					if( hash == keycache_hash )
+					{
+						priv = keycache_priv;
+						pub = keycache_pub;
+						cached = true;
+					}
+				}
+
+				if( cached )
+				{
+					// Validated when cached
+					c = RSAWrapperPtr(new RSAWrapper( RSAWrapper::ValidateNone ) );
+					c->LoadPrivKeyFromDER( priv.data(), priv.size() );
+					c->LoadPubKeyFromDER( pub );
+					break;
+				}
+
+				CryptoHelper::Base64Decode( id["privkey"], priv );
+				pub = CryptoHelper::Base64Decode( id["pubkey"] );
+
 				c = RSAWrapperPtr(new RSAWrapper);
 				// Key found
-				c->LoadPrivKeyFromDER( CryptoHelper::Base64Decode( id["privkey"]) );
-				c->LoadPubKeyFromDER( CryptoHelper::Base64Decode( id["pubkey"]) );
+				c->LoadPrivKeyFromDER( priv.data(), priv.size() );
+				c->LoadPubKeyFromDER( pub );
+
+				lock_guard<mutex> lock(keycache_lock);
+				keycache_hash = hash;
+				keycache_priv = priv;
+				keycache_pub = pub;
 				break;
 			}
 		}
@@ -263,6 +318,15 @@ RSAWrapperPtr AuthServer::GetKeysFromSecop()
 	return c;
 }
 
+void AuthServer::ClearKeyCache()
+{
+	lock_guard<mutex> lock(keycache_lock);
+
+	keycache_hash = "";
+	keycache_priv.clear();
+	keycache_pub.clear();
+}
+
 RSAWrapperPtr AuthServer::GetKeysFromFile(const string &pubpath, const string &privpath)
 {
 	CryptoHelper::RSAWrapperPtr c( new RSAWrapper );
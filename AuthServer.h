@@ -53,11 +53,26 @@ public:
 
 	/**
 	 * @brief Setup, create keys and register in Secop if needed
+	 *
+	 * Keys are taken from CryptoHelper::RSAKeyPool. The library does
+	 * not reserve any, the application running first boot setup has
+	 * to call RSAKeyPool::Instance().Reserve() at startup, well ahead
+	 * of Setup, for this to return without delay. Otherwise a 3072
+	 * bit key is generated inline, taking seconds on ARM boards.
 	 */
 	static void Setup();
 
+	/**
+	 * @brief GetKeysFromSecop, get backend keys
+	 *
+	 * Keys are cached once validated and only reloaded
+	 * when the identifier in secop changes. Each call returns
+	 * a wrapper of its own, safe to modify.
+	 */
 	static RSAWrapperPtr GetKeysFromSecop();
 
+	static void ClearKeyCache();
+
 	static RSAWrapperPtr GetKeysFromFile(const string& pubpath, const string& privpath);
 
 
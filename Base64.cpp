@@ -0,0 +1,534 @@
+#include "Base64.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BASE64_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+namespace OPI {
+namespace Base64 {
+
+static const char alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const int8_t reverse[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/*
+ * Block functions process as many whole blocks as possible and
+ * return number of input bytes consumed. Decoders stop at the first
+ * block containing a character outside the alphabet.
+ */
+typedef size_t (*BlockFunc)(const uint8_t* src, size_t len, uint8_t* dst);
+
+static size_t encode_none(const uint8_t*, size_t, uint8_t*)
+{
+	return 0;
+}
+
+static size_t decode_none(const uint8_t*, size_t, uint8_t*)
+{
+	return 0;
+}
+
+#ifdef BASE64_X86
+
+/*
+ * SSE/AVX2 implementation after W. Mula and D. Lemire, "Faster Base64
+ * Encoding and Decoding Using AVX2 Instructions".
+ */
+
+__attribute__((target("ssse3")))
+static inline __m128i enc_reshuffle(__m128i in)
+{
+	in = _mm_shuffle_epi8( in, _mm_set_epi8( 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1 ) );
+
+	const __m128i t0 = _mm_and_si128( in, _mm_set1_epi32( 0x0fc0fc00 ) );
+	const __m128i t1 = _mm_mulhi_epu16( t0, _mm_set1_epi32( 0x04000040 ) );
+	const __m128i t2 = _mm_and_si128( in, _mm_set1_epi32( 0x003f03f0 ) );
+	const __m128i t3 = _mm_mullo_epi16( t2, _mm_set1_epi32( 0x01000010 ) );
+
+	return _mm_or_si128( t1, t3 );
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i enc_translate(__m128i in)
+{
+	const __m128i lut = _mm_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		'/' - 63, 'A', 0, 0 );
+
+	__m128i idx = _mm_subs_epu8( in, _mm_set1_epi8( 51 ) );
+	const __m128i less = _mm_cmpgt_epi8( _mm_set1_epi8( 26 ), in );
+	idx = _mm_or_si128( idx, _mm_and_si128( less, _mm_set1_epi8( 13 ) ) );
+
+	return _mm_add_epi8( _mm_shuffle_epi8( lut, idx ), in );
+}
+
+/* Returns false if any character is outside the alphabet */
+__attribute__((target("ssse3")))
+static inline bool dec_translate(__m128i in, __m128i& out)
+{
+	const __m128i shiftlut = _mm_setr_epi8( 0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+	const __m128i masklut = _mm_setr_epi8(
+		(char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+		(char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf0, 0x54,
+		0x50, 0x50, 0x50, 0x54 );
+	const __m128i bitlut = _mm_setr_epi8( 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80,
+		0, 0, 0, 0, 0, 0, 0, 0 );
+
+	const __m128i hi = _mm_and_si128( _mm_srli_epi32( in, 4 ), _mm_set1_epi8( 0x0f ) );
+	const __m128i lo = _mm_and_si128( in, _mm_set1_epi8( 0x0f ) );
+
+	const __m128i mask = _mm_shuffle_epi8( masklut, lo );
+	const __m128i bit = _mm_shuffle_epi8( bitlut, hi );
+	const __m128i invalid = _mm_cmpeq_epi8( _mm_and_si128( mask, bit ), _mm_setzero_si128() );
+	if( _mm_movemask_epi8( invalid ) != 0 )
+	{
+		return false;
+	}
+
+	// '/' shares high nibble with '+' but needs a shift of 16, not 19
+	__m128i shift = _mm_shuffle_epi8( shiftlut, hi );
+	const __m128i slash = _mm_cmpeq_epi8( in, _mm_set1_epi8( '/' ) );
+	shift = _mm_add_epi8( shift, _mm_and_si128( slash, _mm_set1_epi8( -3 ) ) );
+
+	out = _mm_add_epi8( in, shift );
+
+	return true;
+}
+
+/* Pack 16 six bit values into 12 bytes, stored without overrun */
+__attribute__((target("ssse3")))
+static inline void dec_pack(__m128i values, uint8_t* dst)
+{
+	const __m128i ab_bc = _mm_maddubs_epi16( values, _mm_set1_epi32( 0x01400140 ) );
+	const __m128i merged = _mm_madd_epi16( ab_bc, _mm_set1_epi32( 0x00011000 ) );
+	const __m128i out = _mm_shuffle_epi8( merged,
+		_mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 ) );
+
+	_mm_storel_epi64( (__m128i*) dst, out );
+	uint32_t tail = _mm_cvtsi128_si32( _mm_srli_si128( out, 8 ) );
+	memcpy( dst + 8, &tail, 4 );
+}
+
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(const uint8_t* src, size_t len, uint8_t* dst)
+{
+	size_t i = 0;
+
+	// Reads 16 bytes, consumes 12
+	for( ; i + 16 <= len; i += 12 )
+	{
+		__m128i in = _mm_loadu_si128( (const __m128i*)( src + i ) );
+		_mm_storeu_si128( (__m128i*) dst, enc_translate( enc_reshuffle( in ) ) );
+		dst += 16;
+	}
+
+	return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(const uint8_t* src, size_t len, uint8_t* dst)
+{
+	size_t i = 0;
+
+	for( ; i + 16 <= len; i += 16 )
+	{
+		__m128i values;
+		if( ! dec_translate( _mm_loadu_si128( (const __m128i*)( src + i ) ), values ) )
+		{
+			break;
+		}
+		dec_pack( values, dst );
+		dst += 12;
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t encode_avx2(const uint8_t* src, size_t len, uint8_t* dst)
+{
+	const __m256i shuf = _mm256_set_epi8(
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1 );
+	const __m256i lut = _mm256_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		'/' - 63, 'A', 0, 0,
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		'/' - 63, 'A', 0, 0 );
+
+	size_t i = 0;
+
+	// Reads 28 bytes, 12 + 16 in two lanes, consumes 24
+	for( ; i + 28 <= len; i += 24 )
+	{
+		__m256i in = _mm256_inserti128_si256(
+			_mm256_castsi128_si256( _mm_loadu_si128( (const __m128i*)( src + i ) ) ),
+			_mm_loadu_si128( (const __m128i*)( src + i + 12 ) ), 1 );
+
+		in = _mm256_shuffle_epi8( in, shuf );
+		const __m256i t0 = _mm256_and_si256( in, _mm256_set1_epi32( 0x0fc0fc00 ) );
+		const __m256i t1 = _mm256_mulhi_epu16( t0, _mm256_set1_epi32( 0x04000040 ) );
+		const __m256i t2 = _mm256_and_si256( in, _mm256_set1_epi32( 0x003f03f0 ) );
+		const __m256i t3 = _mm256_mullo_epi16( t2, _mm256_set1_epi32( 0x01000010 ) );
+		const __m256i idx6 = _mm256_or_si256( t1, t3 );
+
+		__m256i idx = _mm256_subs_epu8( idx6, _mm256_set1_epi8( 51 ) );
+		const __m256i less = _mm256_cmpgt_epi8( _mm256_set1_epi8( 26 ), idx6 );
+		idx = _mm256_or_si256( idx, _mm256_and_si256( less, _mm256_set1_epi8( 13 ) ) );
+
+		_mm256_storeu_si256( (__m256i*) dst, _mm256_add_epi8( _mm256_shuffle_epi8( lut, idx ), idx6 ) );
+		dst += 32;
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t decode_avx2(const uint8_t* src, size_t len, uint8_t* dst)
+{
+	const __m256i shiftlut = _mm256_setr_epi8(
+		0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+	const __m256i masklut = _mm256_setr_epi8(
+		(char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+		(char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf0, 0x54,
+		0x50, 0x50, 0x50, 0x54,
+		(char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+		(char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf0, 0x54,
+		0x50, 0x50, 0x50, 0x54 );
+	const __m256i bitlut = _mm256_setr_epi8(
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80, 0, 0, 0, 0, 0, 0, 0, 0,
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80, 0, 0, 0, 0, 0, 0, 0, 0 );
+	const __m256i packshuf = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 );
+
+	size_t i = 0;
+
+	for( ; i + 32 <= len; i += 32 )
+	{
+		const __m256i in = _mm256_loadu_si256( (const __m256i*)( src + i ) );
+
+		const __m256i hi = _mm256_and_si256( _mm256_srli_epi32( in, 4 ), _mm256_set1_epi8( 0x0f ) );
+		const __m256i lo = _mm256_and_si256( in, _mm256_set1_epi8( 0x0f ) );
+
+		const __m256i mask = _mm256_shuffle_epi8( masklut, lo );
+		const __m256i bit = _mm256_shuffle_epi8( bitlut, hi );
+		const __m256i invalid = _mm256_cmpeq_epi8( _mm256_and_si256( mask, bit ), _mm256_setzero_si256() );
+		if( _mm256_movemask_epi8( invalid ) != 0 )
+		{
+			break;
+		}
+
+		__m256i shift = _mm256_shuffle_epi8( shiftlut, hi );
+		const __m256i slash = _mm256_cmpeq_epi8( in, _mm256_set1_epi8( '/' ) );
+		shift = _mm256_add_epi8( shift, _mm256_and_si256( slash, _mm256_set1_epi8( -3 ) ) );
+		const __m256i values = _mm256_add_epi8( in, shift );
+
+		const __m256i ab_bc = _mm256_maddubs_epi16( values, _mm256_set1_epi32( 0x01400140 ) );
+		const __m256i merged = _mm256_madd_epi16( ab_bc, _mm256_set1_epi32( 0x00011000 ) );
+		const __m256i out = _mm256_shuffle_epi8( merged, packshuf );
+
+		// 12 valid bytes in each lane
+		const __m128i lane0 = _mm256_castsi256_si128( out );
+		const __m128i lane1 = _mm256_extracti128_si256( out, 1 );
+		_mm_storel_epi64( (__m128i*) dst, lane0 );
+		uint32_t tail = _mm_cvtsi128_si32( _mm_srli_si128( lane0, 8 ) );
+		memcpy( dst + 8, &tail, 4 );
+		_mm_storel_epi64( (__m128i*)( dst + 12 ), lane1 );
+		tail = _mm_cvtsi128_si32( _mm_srli_si128( lane1, 8 ) );
+		memcpy( dst + 20, &tail, 4 );
+
+		dst += 24;
+	}
+
+	// Finish off with narrower blocks
+	return i + decode_ssse3( src + i, len - i, dst );
+}
+
+#endif
+
+#ifdef BASE64_NEON
+
+/*
+ * NEON, six bit values are translated arithmetically which works
+ * on both ARMv7 and AArch64.
+ */
+
+static inline uint8x16_t enc_translate(uint8x16_t v)
+{
+	uint8x16_t c = vaddq_u8( v, vdupq_n_u8( 'A' ) );
+
+	c = vaddq_u8( c, vandq_u8( vcgeq_u8( v, vdupq_n_u8( 26 ) ), vdupq_n_u8( 'a' - 'A' - 26 ) ) );
+	c = vsubq_u8( c, vandq_u8( vcgeq_u8( v, vdupq_n_u8( 52 ) ), vdupq_n_u8( 'a' + 26 - '0' ) ) );
+	c = vsubq_u8( c, vandq_u8( vcgeq_u8( v, vdupq_n_u8( 62 ) ), vdupq_n_u8( '0' + 10 - '+' ) ) );
+	c = vaddq_u8( c, vandq_u8( vcgeq_u8( v, vdupq_n_u8( 63 ) ), vdupq_n_u8( '/' - '+' - 1 ) ) );
+
+	return c;
+}
+
+/* Invalid lanes are flagged in valid */
+static inline uint8x16_t dec_translate(uint8x16_t c, uint8x16_t& valid)
+{
+	const uint8x16_t upper = vcleq_u8( vsubq_u8( c, vdupq_n_u8( 'A' ) ), vdupq_n_u8( 25 ) );
+	const uint8x16_t lower = vcleq_u8( vsubq_u8( c, vdupq_n_u8( 'a' ) ), vdupq_n_u8( 25 ) );
+	const uint8x16_t digit = vcleq_u8( vsubq_u8( c, vdupq_n_u8( '0' ) ), vdupq_n_u8( 9 ) );
+	const uint8x16_t plus = vceqq_u8( c, vdupq_n_u8( '+' ) );
+	const uint8x16_t slash = vceqq_u8( c, vdupq_n_u8( '/' ) );
+
+	valid = vandq_u8( valid, vorrq_u8( vorrq_u8( upper, lower ), vorrq_u8( vorrq_u8( digit, plus ), slash ) ) );
+
+	uint8x16_t v = vandq_u8( upper, vsubq_u8( c, vdupq_n_u8( 'A' ) ) );
+	v = vorrq_u8( v, vandq_u8( lower, vsubq_u8( c, vdupq_n_u8( 'a' - 26 ) ) ) );
+	v = vorrq_u8( v, vandq_u8( digit, vaddq_u8( c, vdupq_n_u8( 52 - '0' ) ) ) );
+	v = vorrq_u8( v, vandq_u8( plus, vdupq_n_u8( 62 ) ) );
+	v = vorrq_u8( v, vandq_u8( slash, vdupq_n_u8( 63 ) ) );
+
+	return v;
+}
+
+static size_t encode_neon(const uint8_t* src, size_t len, uint8_t* dst)
+{
+	size_t i = 0;
+
+	for( ; i + 48 <= len; i += 48 )
+	{
+		const uint8x16x3_t in = vld3q_u8( src + i );
+		uint8x16x4_t out;
+
+		out.val[0] = vshrq_n_u8( in.val[0], 2 );
+		out.val[1] = vandq_u8( vorrq_u8( vshrq_n_u8( in.val[1], 4 ), vshlq_n_u8( in.val[0], 4 ) ), vdupq_n_u8( 0x3f ) );
+		out.val[2] = vandq_u8( vorrq_u8( vshrq_n_u8( in.val[2], 6 ), vshlq_n_u8( in.val[1], 2 ) ), vdupq_n_u8( 0x3f ) );
+		out.val[3] = vandq_u8( in.val[2], vdupq_n_u8( 0x3f ) );
+
+		for( int j = 0; j < 4; j++ )
+		{
+			out.val[j] = enc_translate( out.val[j] );
+		}
+
+		vst4q_u8( dst, out );
+		dst += 64;
+	}
+
+	return i;
+}
+
+static size_t decode_neon(const uint8_t* src, size_t len, uint8_t* dst)
+{
+	size_t i = 0;
+
+	for( ; i + 64 <= len; i += 64 )
+	{
+		uint8x16x4_t in = vld4q_u8( src + i );
+		uint8x16_t valid = vdupq_n_u8( 0xff );
+
+		for( int j = 0; j < 4; j++ )
+		{
+			in.val[j] = dec_translate( in.val[j], valid );
+		}
+
+		// All lanes valid?
+		const uint8x8_t folded = vand_u8( vget_low_u8( valid ), vget_high_u8( valid ) );
+		if( vget_lane_u64( vreinterpret_u64_u8( folded ), 0 ) != UINT64_MAX )
+		{
+			break;
+		}
+
+		uint8x16x3_t out;
+		out.val[0] = vorrq_u8( vshlq_n_u8( in.val[0], 2 ), vshrq_n_u8( in.val[1], 4 ) );
+		out.val[1] = vorrq_u8( vshlq_n_u8( in.val[1], 4 ), vshrq_n_u8( in.val[2], 2 ) );
+		out.val[2] = vorrq_u8( vshlq_n_u8( in.val[2], 6 ), in.val[3] );
+
+		vst3q_u8( dst, out );
+		dst += 48;
+	}
+
+	return i;
+}
+
+#endif
+
+struct Codec
+{
+	BlockFunc encode;
+	BlockFunc decode;
+	const char* name;
+};
+
+static Codec select_codec()
+{
+#ifdef BASE64_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx2" ) )
+	{
+		return { encode_avx2, decode_avx2, "avx2" };
+	}
+	if( __builtin_cpu_supports( "ssse3" ) )
+	{
+		return { encode_ssse3, decode_ssse3, "ssse3" };
+	}
+#elif defined(BASE64_NEON)
+	return { encode_neon, decode_neon, "neon" };
+#endif
+	return { encode_none, decode_none, "scalar" };
+}
+
+static const Codec& codec()
+{
+	static const Codec c = select_codec();
+
+	return c;
+}
+
+size_t EncodedSize(size_t len)
+{
+	return ( ( len + 2 ) / 3 ) * 4;
+}
+
+size_t MaxDecodedSize(size_t len)
+{
+	return ( len / 4 ) * 3 + ( len % 4 );
+}
+
+size_t Encode(const uint8_t *in, size_t len, char *out)
+{
+	uint8_t* dst = (uint8_t*) out;
+
+	size_t i = codec().encode( in, len, dst );
+	dst += ( i / 3 ) * 4;
+
+	for( ; i + 3 <= len; i += 3 )
+	{
+		uint32_t v = ( in[i] << 16 ) | ( in[i + 1] << 8 ) | in[i + 2];
+
+		dst[0] = alphabet[ ( v >> 18 ) & 0x3f ];
+		dst[1] = alphabet[ ( v >> 12 ) & 0x3f ];
+		dst[2] = alphabet[ ( v >> 6 ) & 0x3f ];
+		dst[3] = alphabet[ v & 0x3f ];
+		dst += 4;
+	}
+
+	if( i < len )
+	{
+		uint32_t v = in[i] << 16;
+		if( i + 1 < len )
+		{
+			v |= in[i + 1] << 8;
+		}
+
+		dst[0] = alphabet[ ( v >> 18 ) & 0x3f ];
+		dst[1] = alphabet[ ( v >> 12 ) & 0x3f ];
+		dst[2] = i + 1 < len ? alphabet[ ( v >> 6 ) & 0x3f ] : '=';
+		dst[3] = '=';
+		dst += 4;
+	}
+
+	return dst - (uint8_t*) out;
+}
+
+size_t Decode(const char *in, size_t len, uint8_t *out)
+{
+	const uint8_t* src = (const uint8_t*) in;
+	const uint8_t* end = src + len;
+	uint8_t* dst = out;
+
+	// Bits not yet written, count of six bit groups held
+	uint32_t acc = 0;
+	int groups = 0;
+
+	while( src < end )
+	{
+		if( groups == 0 )
+		{
+			// Aligned on a quad, take the fast paths as far as possible
+			size_t done = codec().decode( src, end - src, dst );
+			src += done;
+			dst += ( done / 4 ) * 3;
+
+			for( ; end - src >= 4; src += 4 )
+			{
+				const int8_t a = reverse[ src[0] ], b = reverse[ src[1] ];
+				const int8_t c = reverse[ src[2] ], d = reverse[ src[3] ];
+				if( ( a | b | c | d ) < 0 )
+				{
+					break;
+				}
+				uint32_t v = ( a << 18 ) | ( b << 12 ) | ( c << 6 ) | d;
+				dst[0] = v >> 16;
+				dst[1] = v >> 8;
+				dst[2] = v;
+				dst += 3;
+			}
+
+			if( src == end )
+			{
+				break;
+			}
+		}
+
+		int8_t v = reverse[ *src++ ];
+		if( v < 0 )
+		{
+			continue;
+		}
+
+		acc = ( acc << 6 ) | v;
+		if( ++groups == 4 )
+		{
+			dst[0] = acc >> 16;
+			dst[1] = acc >> 8;
+			dst[2] = acc;
+			dst += 3;
+			acc = 0;
+			groups = 0;
+		}
+	}
+
+	// Trailing partial quad, incomplete bytes are dropped
+	if( groups == 2 )
+	{
+		*dst++ = acc >> 4;
+	}
+	else if( groups == 3 )
+	{
+		*dst++ = acc >> 10;
+		*dst++ = acc >> 2;
+	}
+
+	return dst - out;
+}
+
+const char *Implementation()
+{
+	return codec().name;
+}
+
+}
+}
@@ -0,0 +1,38 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace OPI {
+namespace Base64 {
+
+/*
+ * Vectorised base64 codec used by the CryptoHelper Base64 functions.
+ *
+ * Behaves as the Crypto++ encoder without line breaks and the
+ * Crypto++ decoder, i.e. characters outside the alphabet, padding
+ * and white space included, are skipped when decoding.
+ *
+ * On x86 the fastest implementation supported by the CPU, AVX2 or
+ * SSSE3, is selected at runtime. NEON is selected at compile time,
+ * i.e. always on aarch64 but on 32 bit ARM only when built with
+ * -mfpu=neon. Otherwise the scalar implementation is used.
+ */
+
+size_t EncodedSize(size_t len);
+size_t MaxDecodedSize(size_t len);
+
+/* Out has to hold EncodedSize(len) bytes, returns bytes written */
+size_t Encode(const uint8_t* in, size_t len, char* out);
+
+/* Out has to hold MaxDecodedSize(len) bytes, returns bytes written */
+size_t Decode(const char* in, size_t len, uint8_t* out);
+
+/* Name of implementation in use */
+const char* Implementation();
+
+}
+}
+
+#endif // BASE64_H
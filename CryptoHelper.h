@@ -1,12 +1,25 @@
 #ifndef CRYPTOHELPER_H
 #define CRYPTOHELPER_H
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include <crypto++/rsa.h>
+#include <crypto++/eccrypto.h>
 #include <crypto++/osrng.h>
 #include <crypto++/modes.h>
+#include <crypto++/pssr.h>
+#include <crypto++/sha.h>
+
+#include "SecureArena.h"
 
 using namespace CryptoPP;
 using namespace std;
@@ -15,14 +28,89 @@ namespace OPI {
 namespace CryptoHelper {
 
 
+/*
+ * Containers for secrets, allocated from locked memory that is
+ * zeroized on release, see SecureArena
+ */
 template<typename T>
-using SecVector = vector<T, AllocatorWithCleanup<T>>;
+using SecVector = vector<T, SecureAllocator<T>>;
 
 template<typename T>
-using SecBasicString = basic_string<T, char_traits<T>, AllocatorWithCleanup<T>>;
+using SecBasicString = basic_string<T, char_traits<T>, SecureAllocator<T>>;
 
 typedef SecBasicString<char> SecString;
 
+/*
+ *
+ * Random numbers
+ *
+ * Generator of the calling thread, seeded from the OS on first use
+ * in each thread and reseeded in forked children. Used by all
+ * CryptoHelper primitives, never share the reference between threads.
+ *
+ */
+
+RandomNumberGenerator& RNG();
+
+/*
+ *
+ * Signing keys
+ *
+ */
+
+/*
+ * Common interface of asymmetric signing keys.
+ *
+ * Public keys are exported as X.509 SubjectPublicKeyInfo, which
+ * is what "BEGIN PUBLIC KEY" PEM contains, regardless of algorithm.
+ *
+ * Signing and verifying may be done from several threads at once,
+ * loading keys may not.
+ */
+class SigningKey
+{
+public:
+	/*
+	 * Validation performed when loading keys.
+	 *
+	 * Cheap checks key consistency, full also performs
+	 * primality tests which are expensive on slow targets.
+	 */
+	enum Validation {
+		ValidateNone	= 0,
+		ValidateCheap	= 1,
+		ValidateFull	= 3
+	};
+
+	SigningKey(Validation validation = ValidateFull);
+
+	void SetValidation(Validation validation);
+	Validation GetValidation();
+
+	virtual string PubKeyAsPEM() = 0;
+	virtual string PrivKeyAsPEM() = 0;
+
+	virtual void LoadPubKeyFromPEM(const string& key) = 0;
+	virtual void LoadPubKeyFromDER(const vector<byte>& key) = 0;
+	virtual void LoadPrivKeyFromPEM(const string& key) = 0;
+	virtual void LoadPrivKeyFromDER(const vector<byte>& key) = 0;
+
+	virtual vector<byte> GetPubKeyAsDER() = 0;
+	virtual vector<byte> GetPrivKeyAsDER() = 0;
+
+	virtual vector<byte> SignMessage(const string& message) = 0;
+	virtual bool VerifyMessage(const string& message, const string &signature) = 0;
+	virtual bool VerifyMessage(const string &message, const vector<byte>& signature) = 0;
+
+	virtual ~SigningKey();
+protected:
+	static vector<byte> PEMToDER(const string& key);
+	static string DERToPEM(const vector<byte>& der, const string& label);
+
+	Validation validation;
+};
+
+typedef shared_ptr<SigningKey> SigningKeyPtr;
 
 /*
  *
@@ -33,10 +121,10 @@ typedef SecBasicString<char> SecString;
 typedef std::shared_ptr<RSA::PublicKey> PublicKeyPtr;
 typedef std::shared_ptr<RSA::PrivateKey> PrivateKeyPtr;
 
-class RSAWrapper
+class RSAWrapper: public SigningKey
 {
 public:
-	RSAWrapper();
+	RSAWrapper(Validation validation = ValidateFull);
 
 	void GenerateKeys(unsigned int size=3072);
 
@@ -46,37 +134,138 @@ public:
 	void SavePrivKey(const string& path, mode_t mask = 0077);
 	void SavePubKey(const string& path, mode_t mask = 0002);
 
-	string PubKeyAsPEM();
-	string PrivKeyAsPEM();
+	string PubKeyAsPEM() override;
+	string PrivKeyAsPEM() override;
 
 	void LoadPubKey(const vector<byte>& key);
-	void LoadPubKeyFromPEM(const string& key);
-	void LoadPubKeyFromDER(const vector<byte>& key);
+	void LoadPubKeyFromPEM(const string& key) override;
+	void LoadPubKeyFromDER(const vector<byte>& key) override;
 	void LoadPrivKey(const vector<byte>& key);
-	void LoadPrivKeyFromPEM(const string& key);
-	void LoadPrivKeyFromDER(const vector<byte>& key);
+	void LoadPrivKeyFromPEM(const string& key) override;
+	void LoadPrivKeyFromDER(const vector<byte>& key) override;
+	void LoadPrivKeyFromDER(const byte* key, size_t len);
 
 	vector<byte> GetPubKey();
-	vector<byte> GetPubKeyAsDER();
+	vector<byte> GetPubKeyAsDER() override;
 	vector<byte> GetPrivKey();
-	vector<byte> GetPrivKeyAsDER();
+	vector<byte> GetPrivKeyAsDER() override;
 
-	vector<byte> SignMessage(const string& message);
-	bool VerifyMessage(const string& message, const string &signature);
-	bool VerifyMessage(const string &message, const vector<byte>& signature);
+	vector<byte> SignMessage(const string& message) override;
+	bool VerifyMessage(const string& message, const string &signature) override;
+	bool VerifyMessage(const string &message, const vector<byte>& signature) override;
 
 private:
-	static vector<byte> PEMToDER(const string& key);
 	void ValidatePrivKey();
 	void ValidatePubKey();
 	bool priv_i, pub_i; // Keys initialized?
 	PrivateKeyPtr privkey;
 	PublicKeyPtr pubkey;
-	AutoSeededRandomPool rng;
+	// Created when a key is loaded, making sign and verify thread safe
+	unique_ptr<RSASS<PKCS1v15, SHA1>::Signer> signer;
+	unique_ptr<RSASS<PKCS1v15, SHA1>::Verifier> verifier;
 };
 
 typedef shared_ptr<RSAWrapper> RSAWrapperPtr;
 
+/*
+ * Pool of pre generated RSA keys.
+ *
+ * Keys of reserved sizes are generated on a background thread, at
+ * idle priority, and kept DER encoded in locked memory which is
+ * wiped when released. Get hands out a pooled key at once and falls
+ * back to generating one inline when none is available.
+ *
+ * The process wide Instance is stopped when destroyed at exit, which
+ * waits for a key in progress. Call Stop explicitly to end generation
+ * earlier. Instance must not be used from destructors of statics.
+ */
+class RSAKeyPool
+{
+public:
+	RSAKeyPool();
+
+	static RSAKeyPool& Instance();
+
+	/* Keep count keys of size bits ready, starts background generation */
+	void Reserve(unsigned int bits = 3072, size_t count = 1);
+
+	RSAWrapperPtr Get(unsigned int bits = 3072, SigningKey::Validation validation = SigningKey::ValidateFull);
+
+	/* Number of ready keys of size bits */
+	size_t Available(unsigned int bits = 3072);
+
+	/*
+	 * Stop background generation, waiting for a key in progress,
+	 * and wipe all pooled keys
+	 */
+	void Stop();
+
+	virtual ~RSAKeyPool();
+private:
+	/* Pooled key pair, private part in locked memory */
+	struct PooledKey {
+		SecVector<byte> priv;
+		vector<byte> pub;
+	};
+
+	void Worker();
+	static PooledKey Generate(unsigned int bits);
+
+	mutex lock;
+	condition_variable cond;
+	bool stopping;
+	thread worker;
+	map<unsigned int, size_t> reserved;
+	map<unsigned int, deque<PooledKey>> keys;
+};
+
+/*
+ *
+ * ECDSA, NIST P-256 with SHA-256
+ *
+ * Key generation and signing are orders of magnitude faster than
+ * RSA of comparable strength. Private keys are PKCS#8 encoded,
+ * signatures are in IEEE P1363 format, i.e. r || s, 64 bytes.
+ *
+ */
+
+class ECDSAKey: public SigningKey
+{
+public:
+	ECDSAKey(Validation validation = ValidateFull);
+
+	void GenerateKeys();
+
+	string PubKeyAsPEM() override;
+	string PrivKeyAsPEM() override;
+
+	void LoadPubKeyFromPEM(const string& key) override;
+	void LoadPubKeyFromDER(const vector<byte>& key) override;
+	void LoadPrivKeyFromPEM(const string& key) override;
+	void LoadPrivKeyFromDER(const vector<byte>& key) override;
+
+	vector<byte> GetPubKeyAsDER() override;
+	vector<byte> GetPrivKeyAsDER() override;
+
+	vector<byte> SignMessage(const string& message) override;
+	bool VerifyMessage(const string& message, const string &signature) override;
+	bool VerifyMessage(const string &message, const vector<byte>& signature) override;
+
+	virtual ~ECDSAKey();
+private:
+	typedef ECDSA<ECP, SHA256> Scheme;
+
+	bool VerifyMessage(const string &message, const byte* signature, size_t len);
+
+	bool priv_i, pub_i; // Keys initialized?
+	Scheme::PrivateKey privkey;
+	Scheme::PublicKey pubkey;
+	unique_ptr<Scheme::Signer> signer;
+	unique_ptr<Scheme::Verifier> verifier;
+};
+
+typedef shared_ptr<ECDSAKey> ECDSAKeyPtr;
+
 /*
  *
  *	AES Wrapper
@@ -96,10 +285,42 @@ public:
 	void Decrypt(const vector<byte>& in, vector<byte>& out);
 	string Decrypt(const vector<byte>& in);
 
+	/*
+	 * Operate directly on caller provided buffers, out has to hold
+	 * at least EncryptedSize(len) bytes when encrypting and len bytes
+	 * when decrypting. Returns number of bytes written.
+	 */
+	static size_t EncryptedSize(size_t len);
+	size_t Encrypt(const byte* in, size_t len, byte* out, size_t outlen);
+	size_t Decrypt(const byte* in, size_t len, byte* out, size_t outlen);
+
+	/*
+	 * Streaming en/decryption, data is processed in chunks of
+	 * ChunkSize using a buffer reused between calls. Output is
+	 * identical to the whole buffer variants. Returns number of
+	 * bytes written.
+	 */
+	static const size_t ChunkSize = 64 * 1024;
+
+	size_t Encrypt(int infd, int outfd);
+	size_t Decrypt(int infd, int outfd);
+	size_t Encrypt(istream& in, ostream& out);
+	size_t Decrypt(istream& in, ostream& out);
+
 	static void SetDefaultIV(const vector<byte>& iv);
 
 	virtual ~AESWrapper();
 private:
+	typedef function<size_t(byte*, size_t)> ChunkReader;
+	typedef function<void(const byte*, size_t)> ChunkWriter;
+
+	size_t Transform(StreamTransformation& mode, const ChunkReader& reader, const ChunkWriter& writer);
+	static ChunkReader FdReader(int fd);
+	static ChunkWriter FdWriter(int fd);
+	static ChunkReader StreamReader(istream& in);
+	static ChunkWriter StreamWriter(ostream& out);
+
+	SecVector<byte> chunk;
 
 	SecVector<byte> key;
 	vector<byte> iv;
@@ -113,6 +334,59 @@ private:
 
 typedef shared_ptr<AESWrapper> AESWrapperPtr;
 
+/*
+ *
+ *	AES-GCM Wrapper
+ *
+ *	Authenticated AES-256-GCM. Each message gets a random salt from
+ *	which a message key is derived, using HKDF-SHA256. The message is
+ *	split in chunks that are encrypted and authenticated independently
+ *	and in parallel on all cores. Chunk nonces hold the chunk index
+ *	and a last chunk flag, so reordered or truncated messages fail.
+ *
+ *	Format: version(1) chunksize(4, BE) salt(16), then per chunk
+ *	ciphertext followed by a 16 byte tag.
+ *
+ */
+
+class AESGCMWrapper {
+public:
+	static const size_t KeySize = 32;
+	static const size_t DefaultChunkSize = 1024 * 1024;
+
+	AESGCMWrapper();
+	AESGCMWrapper(const SecVector<byte>& key, size_t chunksize = DefaultChunkSize);
+
+	void Initialize(const SecVector<byte>& key, size_t chunksize = DefaultChunkSize);
+
+	string Encrypt(const string& s);
+	void Encrypt(const vector<byte>& in, vector<byte>& out);
+
+	/* Throws if authentication fails */
+	string Decrypt(const string& s);
+	void Decrypt(const vector<byte>& in, vector<byte>& out);
+
+	/*
+	 * Operate directly on caller provided buffers, sizes are given
+	 * by EncryptedSize and DecryptedSize. Returns bytes written.
+	 */
+	size_t EncryptedSize(size_t len);
+	size_t Encrypt(const byte* in, size_t len, byte* out, size_t outlen);
+	size_t DecryptedSize(const byte* in, size_t len);
+	size_t Decrypt(const byte* in, size_t len, byte* out, size_t outlen);
+
+	/* True if Crypto++ uses AES and carryless multiply instructions */
+	static bool HardwareAccelerated();
+
+	virtual ~AESGCMWrapper();
+private:
+
+	SecVector<byte> key;
+	size_t chunksize;
+};
+
+typedef shared_ptr<AESGCMWrapper> AESGCMWrapperPtr;
+
 /*
  *
  * Crypt tools
@@ -120,9 +394,31 @@ typedef shared_ptr<AESWrapper> AESWrapperPtr;
  */
 
 
-bool MakeCSR(const string& privkeypath, const string& csrpath, const string& cn, const string& company);
+/*
+ * Certificate requests and self signed certificates, generated in
+ * process using libcrypto.
+ *
+ * Key is a PEM encoded private key, digest an openssl digest name.
+ * Subject alternative names are given as in openssl configuration,
+ * i.e. "DNS:example.com" or "IP:10.0.0.1". Errors throws runtime_error.
+ */
+struct X509Object {
+	string pem;
+	vector<byte> der;
+};
+
+X509Object CreateCSR(const string& privkeypem, const string& cn, const string& company,
+		const string& digest = "sha256", const vector<string>& san = {});
+
+X509Object CreateSelfSignedCert(const string& privkeypem, const string& cn, const string& company,
+		const string& digest = "sha512", unsigned int days = 365, const vector<string>& san = {});
 
-bool MakeSelfSignedCert(const string& privkeypath, const string& certpath, const string& cn, const string& company);
+/* As above, reading key from and writing PEM to disk. False on failure */
+bool MakeCSR(const string& privkeypath, const string& csrpath, const string& cn, const string& company,
+		const string& digest = "sha256", const vector<string>& san = {});
+
+bool MakeSelfSignedCert(const string& privkeypath, const string& certpath, const string& cn, const string& company,
+		const string& digest = "sha512", unsigned int days = 365, const vector<string>& san = {});
 
 string Base64Encode(const vector<byte> &in);
 string Base64Encode(const string &s);
@@ -132,6 +428,34 @@ vector<byte> Base64Decode( const string& data);
 void Base64Decode(const string& s, vector<byte>& out);
 void Base64Decode(const string& s, SecVector<byte>& out);
 
+/*
+ * Encode/decode into caller provided buffers, out has to hold at
+ * least Base64EncodedSize/Base64MaxDecodedSize bytes. Returns
+ * number of bytes written.
+ */
+size_t Base64EncodedSize(size_t len);
+size_t Base64MaxDecodedSize(size_t len);
+size_t Base64Encode(const byte* in, size_t len, char* out, size_t outlen);
+size_t Base64Decode(const char* in, size_t len, byte* out, size_t outlen);
+
+/*
+ * PEM, label is the text following BEGIN, i.e. "PUBLIC KEY"
+ *
+ * PEMNext decodes the next object from pos and onwards straight into
+ * der and advances pos past it, text outside of armour is ignored.
+ * Returns false when there are no more objects, throws on malformed
+ * or encrypted objects.
+ */
+struct PEMObject {
+	string label;
+	vector<byte> der;
+};
+
+bool PEMNext(const string& data, size_t& pos, string& label, vector<byte>& der);
+
+/* All objects in data, i.e. a certificate chain */
+vector<PEMObject> PEMParse(const string& data);
+
 
 extern const vector<byte> defaultsalt;
 
@@ -143,6 +467,125 @@ vector<byte> PBKDF2(const string &passwd, size_t keylength,
 		const vector<byte>& salt = defaultsalt, unsigned int iter=5000);
 #endif
 
+/*
+ * Derive many keys concurrently, using all cores
+ */
+struct PBKDF2Request {
+	SecString passwd;
+	size_t keylength;
+	vector<byte> salt;
+	unsigned int iter;
+};
+
+vector<SecVector<byte>> PBKDF2(const vector<PBKDF2Request>& requests);
+
+/*
+ * KDF calibration
+ *
+ * Measures PBKDF2 throughput on the running machine, instead of
+ * relying on fixed iteration counts. SHA1 is what LUKS1 keyslots use.
+ */
+enum PBKDF2Hash {
+	PBKDF2SHA1,
+	PBKDF2SHA256,
+	PBKDF2SHA512
+};
+
+/* HMAC iterations per second, sampled for about sample_ms */
+uint64_t PBKDF2IterationsPerSec(PBKDF2Hash hash = PBKDF2SHA512, unsigned int sample_ms = 100);
+
+/*
+ * Iteration count that makes deriving a keylength key take roughly
+ * target_ms on this machine. Never less than PBKDF2MinIterations.
+ */
+const unsigned int PBKDF2MinIterations = 1000;
+
+unsigned int PBKDF2Calibrate(unsigned int target_ms = 250, size_t keylength = 32,
+		PBKDF2Hash hash = PBKDF2SHA512, unsigned int sample_ms = 100);
+
+/*
+ * Bounded cache of derived keys, least recently used entries are
+ * evicted first. Entries are kept in wiped on free memory and keyed
+ * by a keyed hash of the password, using a random per process key,
+ * together with salt, iterations and key length.
+ */
+class PBKDF2Cache
+{
+public:
+	PBKDF2Cache(size_t maxentries = 32);
+
+	static PBKDF2Cache& Instance();
+
+	SecVector<byte> Derive(const SecString& passwd, size_t keylength,
+		const vector<byte>& salt = defaultsalt, unsigned int iter=5000);
+
+	void SetMaxEntries(size_t maxentries);
+	size_t Size();
+
+	/* Remove and wipe all cached keys */
+	void Wipe();
+
+	virtual ~PBKDF2Cache();
+private:
+	typedef list<SecString> LRUList;
+
+	struct Entry {
+		SecVector<byte> key;
+		LRUList::iterator lru;
+	};
+
+	SecString CacheKey(const SecString& passwd, size_t keylength, const vector<byte>& salt, unsigned int iter);
+	void Evict();
+
+	mutex lock;
+	size_t maxentries;
+	SecVector<byte> hashkey;
+	LRUList lru;
+	map<SecString, Entry> entries;
+};
+
+/*
+ *
+ * Digests
+ *
+ * Streaming digests over data, file descriptors and files. Fd
+ * variants read from the current position until end of file.
+ *
+ */
+
+enum DigestType {
+	DigestSHA256,
+	DigestSHA512,
+	DigestBLAKE2b	// Requires Crypto++ 5.6.4 or later
+};
+
+vector<byte> Digest(const string& data, DigestType type = DigestSHA256);
+vector<byte> Digest(const byte* data, size_t len, DigestType type = DigestSHA256);
+vector<byte> DigestFd(int fd, DigestType type = DigestSHA256);
+vector<byte> DigestFile(const string& path, DigestType type = DigestSHA256);
+
+/*
+ * Tree digest, input is split in chunks of chunksize that are hashed
+ * in parallel using all cores. Root is the digest of the chunk size
+ * and the chunk digests, leaves and root are domain separated:
+ *
+ *   leaf = H( 0x00 || chunk )
+ *   root = H( 0x01 || chunksize, 64 bit big endian || leaf0 || leaf1 ... )
+ *
+ * Not the same value as a plain digest of the data. Regular files are
+ * read concurrently, other fds sequentially with the same result.
+ */
+const size_t TreeChunkSize = 4 * 1024 * 1024;
+
+vector<byte> TreeDigestFd(int fd, DigestType type = DigestSHA256, size_t chunksize = TreeChunkSize);
+vector<byte> TreeDigestFile(const string& path, DigestType type = DigestSHA256, size_t chunksize = TreeChunkSize);
+
+/* Lower case hex, as printed by sha256sum */
+string HexEncode(const vector<byte>& data);
+
+/* True if Crypto++ uses SHA instructions of the CPU for SHA-256 */
+bool DigestHardwareAccelerated();
+
 }
 
 }
@@ -138,15 +138,7 @@ bool DnsServer::Auth(const string &unit_id)
 
 
 		RSAWrapper dnskeys;
-		list<string> rows = File::GetContent( SysConfig().GetKeyAsString("dns", "dnsauthkey") );
-		stringstream pemkey;
-
-		for( const auto& row: rows)
-		{
-			pemkey << row << "\n";
-		}
-
-		dnskeys.LoadPrivKeyFromPEM( pemkey.str() );
+		dnskeys.LoadPrivKeyFromPEM( File::GetContentAsString( SysConfig().GetKeyAsString("dns", "dnsauthkey"), true ) );
 
 		string signedchallenge = Base64Encode( dnskeys.SignMessage( challenge ) );
 
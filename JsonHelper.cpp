@@ -1,6 +1,12 @@
 
+#include <algorithm>
 #include <utility>
 
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cctype>
+
 #include "JsonHelper.h"
 
 namespace OPI {
@@ -100,6 +106,537 @@ Json::Value ToJsonObject(const map<string, string> &objmap)
 	return ret;
 }
 
+/*
+ * CBOR encoding
+ */
+
+enum CborMajor {
+	CborUInt		= 0,
+	CborNegInt		= 1,
+	CborBytes		= 2,
+	CborText		= 3,
+	CborArray		= 4,
+	CborMap			= 5,
+	CborTag			= 6,
+	CborSimple		= 7
+};
+
+#define CBOR_FALSE		0xf4
+#define CBOR_TRUE		0xf5
+#define CBOR_NULL		0xf6
+#define CBOR_FLOAT16	0xf9
+#define CBOR_FLOAT32	0xfa
+#define CBOR_FLOAT64	0xfb
+
+#define CBOR_MAXDEPTH	64
+
+static void cbor_head(string& out, int major, uint64_t val)
+{
+	uint8_t m = major << 5;
+
+	if( val < 24 )
+	{
+		out.push_back( m | val );
+	}
+	else if( val <= 0xff )
+	{
+		out.push_back( m | 24 );
+		out.push_back( val );
+	}
+	else if( val <= 0xffff )
+	{
+		out.push_back( m | 25 );
+		out.push_back( val >> 8 );
+		out.push_back( val );
+	}
+	else if( val <= 0xffffffff )
+	{
+		out.push_back( m | 26 );
+		for( int i = 3; i >= 0; i-- )
+		{
+			out.push_back( val >> ( i * 8 ) );
+		}
+	}
+	else
+	{
+		out.push_back( m | 27 );
+		for( int i = 7; i >= 0; i-- )
+		{
+			out.push_back( val >> ( i * 8 ) );
+		}
+	}
+}
+
+static void cbor_encode(string& out, const Json::Value& val)
+{
+	switch( val.type() )
+	{
+	case Json::nullValue:
+		out.push_back( (char) CBOR_NULL );
+		break;
+	case Json::booleanValue:
+		out.push_back( (char)( val.asBool() ? CBOR_TRUE : CBOR_FALSE ) );
+		break;
+	case Json::intValue:
+	{
+		Json::Int64 i = val.asInt64();
+		if( i < 0 )
+		{
+			cbor_head( out, CborNegInt, -1 - i );
+		}
+		else
+		{
+			cbor_head( out, CborUInt, i );
+		}
+		break;
+	}
+	case Json::uintValue:
+		cbor_head( out, CborUInt, val.asUInt64() );
+		break;
+	case Json::realValue:
+	{
+		double d = val.asDouble();
+		uint64_t bits;
+		memcpy( &bits, &d, sizeof(bits) );
+		out.push_back( (char) CBOR_FLOAT64 );
+		for( int i = 7; i >= 0; i-- )
+		{
+			out.push_back( bits >> ( i * 8 ) );
+		}
+		break;
+	}
+	case Json::stringValue:
+	{
+		const char *start, *end;
+		val.getString( &start, &end );
+		cbor_head( out, CborText, end - start );
+		out.append( start, end - start );
+		break;
+	}
+	case Json::arrayValue:
+		cbor_head( out, CborArray, val.size() );
+		for( const auto& item: val )
+		{
+			cbor_encode( out, item );
+		}
+		break;
+	case Json::objectValue:
+		cbor_head( out, CborMap, val.size() );
+		for( auto it = val.begin(); it != val.end(); it++ )
+		{
+			string key = it.key().asString();
+			cbor_head( out, CborText, key.size() );
+			out.append( key );
+			cbor_encode( out, *it );
+		}
+		break;
+	}
+}
+
+string ToCBOR(const Json::Value &val)
+{
+	string ret;
+
+	cbor_encode( ret, val );
+
+	return ret;
+}
+
+string ToCBORFrame(const Json::Value &val)
+{
+	string ret( 4, '\0' );
+
+	cbor_encode( ret, val );
+
+	uint32_t len = ret.size() - 4;
+	for( int i = 0; i < 4; i++ )
+	{
+		ret[i] = len >> ( ( 3 - i ) * 8 );
+	}
+
+	return ret;
+}
+
+static bool cbor_head(const uint8_t*& p, const uint8_t* end, int& major, uint64_t& val)
+{
+	if( p >= end )
+	{
+		return false;
+	}
+
+	major = *p >> 5;
+	uint8_t info = *p & 0x1f;
+	p++;
+
+	if( info < 24 )
+	{
+		val = info;
+		return true;
+	}
+
+	if( info > 27 )
+	{
+		// Indefinite lengths not supported
+		return false;
+	}
+
+	size_t len = 1 << ( info - 24 );
+	if( (size_t)( end - p ) < len )
+	{
+		return false;
+	}
+
+	val = 0;
+	for( size_t i = 0; i < len; i++ )
+	{
+		val = ( val << 8 ) | *p++;
+	}
+
+	return true;
+}
+
+static bool cbor_decode(const uint8_t*& p, const uint8_t* end, Json::Value& val, int depth)
+{
+	int major;
+	uint64_t arg;
+
+	if( depth > CBOR_MAXDEPTH || p >= end )
+	{
+		return false;
+	}
+
+	uint8_t initial = *p;
+	if( ! cbor_head( p, end, major, arg ) )
+	{
+		return false;
+	}
+
+	switch( major )
+	{
+	case CborUInt:
+		if( arg > (uint64_t) INT64_MAX )
+		{
+			val = Json::Value( (Json::UInt64) arg );
+		}
+		else
+		{
+			val = Json::Value( (Json::Int64) arg );
+		}
+		return true;
+	case CborNegInt:
+		if( arg > (uint64_t) INT64_MAX )
+		{
+			return false;
+		}
+		val = Json::Value( (Json::Int64)( -1 - (int64_t) arg ) );
+		return true;
+	case CborBytes:
+	case CborText:
+		if( (uint64_t)( end - p ) < arg )
+		{
+			return false;
+		}
+		val = Json::Value( (const char*) p, (const char*) p + arg );
+		p += arg;
+		return true;
+	case CborArray:
+		val = Json::Value( Json::arrayValue );
+		for( uint64_t i = 0; i < arg; i++ )
+		{
+			if( ! cbor_decode( p, end, val[ (Json::ArrayIndex) i ], depth + 1 ) )
+			{
+				return false;
+			}
+		}
+		return true;
+	case CborMap:
+		val = Json::Value( Json::objectValue );
+		for( uint64_t i = 0; i < arg; i++ )
+		{
+			Json::Value key;
+			if( ! cbor_decode( p, end, key, depth + 1 ) || ! key.isString() )
+			{
+				return false;
+			}
+			if( ! cbor_decode( p, end, val[ key.asString() ], depth + 1 ) )
+			{
+				return false;
+			}
+		}
+		return true;
+	case CborTag:
+		// Tags carry no meaning for json, decode tagged item
+		return cbor_decode( p, end, val, depth + 1 );
+	case CborSimple:
+		break;
+	}
+
+	switch( initial )
+	{
+	case CBOR_FALSE:
+		val = false;
+		return true;
+	case CBOR_TRUE:
+		val = true;
+		return true;
+	case CBOR_NULL:
+		val = Json::Value();
+		return true;
+	case CBOR_FLOAT16:
+	{
+		// Half precision, RFC 7049 appendix D
+		int e = ( arg >> 10 ) & 0x1f;
+		int m = arg & 0x3ff;
+		double d;
+		if( e == 0 )
+		{
+			d = ldexp( m, -24 );
+		}
+		else if( e != 31 )
+		{
+			d = ldexp( m + 1024, e - 25 );
+		}
+		else
+		{
+			d = m == 0 ? INFINITY : NAN;
+		}
+		val = ( arg & 0x8000 ) ? -d : d;
+		return true;
+	}
+	case CBOR_FLOAT32:
+	{
+		uint32_t bits = arg;
+		float f;
+		memcpy( &f, &bits, sizeof(f) );
+		val = (double) f;
+		return true;
+	}
+	case CBOR_FLOAT64:
+	{
+		double d;
+		memcpy( &d, &arg, sizeof(d) );
+		val = d;
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool FromCBOR(const char *start, const char *end, Json::Value &val)
+{
+	const uint8_t* p = (const uint8_t*) start;
+
+	return cbor_decode( p, (const uint8_t*) end, val, 0 ) && p == (const uint8_t*) end;
+}
+
+StreamFramer::StreamFramer(size_t initialsize):
+	buf(initialsize), framing(JsonFraming), rpos(0), spos(0), wpos(0), depth(0),
+	instring(false), escaped(false), complete(false), failed(false)
+{
+
+}
+
+void StreamFramer::SetFraming(StreamFramer::Framing framing)
+{
+	this->framing = framing;
+
+	// Restart scan of any unconsumed data
+	if( ! this->complete )
+	{
+		// Drop whitespace trailing last json message
+		while( this->rpos < this->wpos && isspace( this->buf[this->rpos] ) )
+		{
+			this->rpos++;
+		}
+
+		this->spos = this->rpos;
+		this->depth = 0;
+		this->instring = this->escaped = false;
+	}
+}
+
+StreamFramer::Framing StreamFramer::GetFraming()
+{
+	return this->framing;
+}
+
+char *StreamFramer::Reserve(size_t size)
+{
+	if( this->buf.size() - this->wpos < size )
+	{
+		// Move unconsumed data to start of buffer before growing
+		if( this->rpos > 0 )
+		{
+			memmove( this->buf.data(), this->buf.data() + this->rpos, this->wpos - this->rpos );
+			this->spos -= this->rpos;
+			this->wpos -= this->rpos;
+			this->rpos = 0;
+		}
+
+		if( this->buf.size() - this->wpos < size )
+		{
+			this->buf.resize( std::max( this->buf.size() * 2, this->wpos + size ) );
+		}
+	}
+
+	return this->buf.data() + this->wpos;
+}
+
+size_t StreamFramer::Space()
+{
+	return this->buf.size() - this->wpos;
+}
+
+void StreamFramer::Commit(size_t len)
+{
+	this->wpos += std::min( len, this->Space() );
+}
+
+void StreamFramer::Append(const char *data, size_t len)
+{
+	memcpy( this->Reserve( len ), data, len );
+	this->Commit( len );
+}
+
+bool StreamFramer::Next(const char *&start, const char *&end)
+{
+	if( ! this->complete && ! this->failed )
+	{
+		this->complete = this->framing == LengthFraming ? this->NextLength() : this->NextJson();
+	}
+
+	if( this->complete )
+	{
+		start = this->buf.data() + this->rpos;
+		end = this->buf.data() + this->spos;
+	}
+
+	return this->complete;
+}
+
+bool StreamFramer::NextLength()
+{
+	if( this->wpos - this->rpos < 4 )
+	{
+		return false;
+	}
+
+	const uint8_t* p = (const uint8_t*) this->buf.data() + this->rpos;
+	size_t len = ( (uint32_t) p[0] << 24 ) | ( (uint32_t) p[1] << 16 ) | ( (uint32_t) p[2] << 8 ) | p[3];
+
+	if( len > MaxFrameSize )
+	{
+		this->failed = true;
+		return false;
+	}
+
+	if( this->wpos - this->rpos - 4 < len )
+	{
+		return false;
+	}
+
+	// Skip length header, message is rpos to spos
+	this->rpos += 4;
+	this->spos = this->rpos + len;
+
+	return true;
+}
+
+bool StreamFramer::NextJson()
+{
+	bool found = false;
+
+	for( ; ! found && this->spos < this->wpos; this->spos++ )
+	{
+		char c = this->buf[this->spos];
+
+		if( this->instring )
+		{
+			if( this->escaped )
+			{
+				this->escaped = false;
+			}
+			else if( c == '\\' )
+			{
+				this->escaped = true;
+			}
+			else if( c == '"' )
+			{
+				this->instring = false;
+			}
+			continue;
+		}
+
+		switch( c )
+		{
+		case '"':
+			this->instring = true;
+			break;
+		case '{':
+		case '[':
+			this->depth++;
+			break;
+		case '}':
+		case ']':
+			if( this->depth > 0 && --this->depth == 0 )
+			{
+				found = true;
+			}
+			break;
+		default:
+			// Skip whitespace between messages
+			if( this->depth == 0 && this->spos == this->rpos )
+			{
+				this->rpos++;
+			}
+			break;
+		}
+	}
+
+	if( ! found && this->spos - this->rpos > MaxFrameSize )
+	{
+		this->failed = true;
+	}
+
+	return found;
+}
+
+void StreamFramer::Consume()
+{
+	if( ! this->complete )
+	{
+		return;
+	}
+
+	this->complete = false;
+	this->rpos = this->spos;
+
+	if( this->rpos == this->wpos )
+	{
+		this->rpos = this->spos = this->wpos = 0;
+	}
+}
+
+size_t StreamFramer::Buffered()
+{
+	return this->wpos - this->rpos;
+}
+
+bool StreamFramer::Failed()
+{
+	return this->failed;
+}
+
+void StreamFramer::Clear()
+{
+	this->rpos = this->spos = this->wpos = 0;
+	this->depth = 0;
+	this->instring = this->escaped = this->complete = this->failed = false;
+}
+
+StreamFramer::~StreamFramer() = default;
+
 } // End namespace JsonHelper
 
 } // END namespace OPI
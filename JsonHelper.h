@@ -54,6 +54,78 @@ map<string,string> FromJsonObject(const Json::Value& jsonobj);
 
 Json::Value ToJsonObject(const map<string,string>& objmap);
 
+/*
+ * Compact binary encoding of json values using CBOR (RFC 7049).
+ * ToCBORFrame prefixes the encoded value with its length as expected
+ * by StreamFramer in LengthFraming mode.
+ */
+string ToCBOR(const Json::Value& val);
+string ToCBORFrame(const Json::Value& val);
+bool FromCBOR(const char* start, const char* end, Json::Value& val);
+
+/*
+ * Incremental framing of a stream of concatenated json objects, or
+ * of length prefixed binary messages.
+ *
+ * Data is written directly into a growable buffer using Reserve/Commit
+ * and scanning for the end of a message resumes where it left off.
+ * Pointers returned by Next are valid until Consume or Reserve is called.
+ *
+ * Messages larger than MaxFrameSize, e.g. due to a corrupt length
+ * header, are a protocol error. Next then keeps returning false and
+ * Failed is true until Clear is called, the stream should be closed.
+ */
+class StreamFramer
+{
+public:
+	enum Framing {
+		JsonFraming,	// Concatenated json objects
+		LengthFraming	// 32 bit big endian length prefixed messages
+	};
+
+	static const size_t MaxFrameSize = 64 * 1024 * 1024;
+
+	StreamFramer(size_t initialsize = 4096);
+
+	void SetFraming(Framing framing);
+	Framing GetFraming();
+
+	/* Get room for at least size bytes, returns write position */
+	char* Reserve(size_t size);
+	/* Number of bytes that can be written at write position */
+	size_t Space();
+	/* Commit len bytes written at write position */
+	void Commit(size_t len);
+
+	void Append(const char* data, size_t len);
+
+	/* Locate next complete message, true if one is available */
+	bool Next(const char*& start, const char*& end);
+	/* Release message returned by Next */
+	void Consume();
+
+	size_t Buffered();
+	/* True if the stream is out of sync, message too large */
+	bool Failed();
+	void Clear();
+
+	virtual ~StreamFramer();
+private:
+	bool NextLength();
+	bool NextJson();
+
+	vector<char> buf;
+	Framing framing;
+	size_t rpos;	// Start of current message
+	size_t spos;	// Scan position
+	size_t wpos;	// End of data
+	int depth;
+	bool instring;
+	bool escaped;
+	bool complete;
+	bool failed;
+};
+
 } // End namespace JsonHelper
 
 } // END namespace OPI
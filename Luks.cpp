@@ -16,7 +16,7 @@ using namespace Utils;
 namespace OPI
 {
 
-Luks::Luks(const string &path): path(path), open(false)
+Luks::Luks(const string &path): path(path), open(false), iteration_ms(0)
 {
 	if( crypt_init( &this->cryptdevice, path.c_str() ) < 0 )
 	{
@@ -79,10 +79,45 @@ bool Luks::isLuks(const string &device)
 	return ret;
 }
 
+void Luks::SetIterationTime(uint64_t ms)
+{
+	this->iteration_ms = ms;
+}
+
+#ifdef CRYPT_LUKS2
+void Luks::BenchmarkPBKDF(crypt_pbkdf_type &pbkdf, size_t keysize)
+{
+	static const string passwd = "calibration password";
+	static const string salt(32, '\x5a');
+
+	int r = crypt_benchmark_pbkdf(
+				nullptr,
+				&pbkdf,
+				passwd.c_str(),
+				passwd.length(),
+				salt.c_str(),
+				salt.length(),
+				keysize,
+				nullptr,
+				nullptr
+				);
+
+	if( r < 0 )
+	{
+		throw Utils::ErrnoException("Failed to benchmark pbkdf");
+	}
+}
+#endif
+
 void Luks::Format(const string &password)
 {
 	struct crypt_params_luks1 params = {};
 
+	if( this->iteration_ms > 0 )
+	{
+		crypt_set_iteration_time( this->cryptdevice, this->iteration_ms );
+	}
+
 	params.hash = "sha1";
 	params.data_alignment = 0;
 	params.data_device = nullptr;
@@ -3,6 +3,7 @@
 
 #include <libcryptsetup.h>
 
+#include <cstdint>
 #include <string>
 
 using namespace std;
@@ -17,6 +18,22 @@ public:
 
 	static bool isLuks(const string& device);
 
+	/*
+	 * Time in ms a keyslot unlock should take on this machine, used
+	 * by libcryptsetup to calibrate iterations on Format. Zero keeps
+	 * the libcryptsetup default.
+	 */
+	void SetIterationTime(uint64_t ms);
+
+#ifdef CRYPT_LUKS2
+	/*
+	 * Benchmark pbkdf, i.e. pbkdf2 or argon2i(d), with the given
+	 * parameters. Fills in iterations, and memory, needed for an
+	 * unlock to take pbkdf.time_ms on this machine.
+	 */
+	static void BenchmarkPBKDF(struct crypt_pbkdf_type& pbkdf, size_t keysize = 256/8);
+#endif
+
 	void Format(const string& password);
 	bool Open(const string& name, const string& password, bool discard = true );
 	bool Active(const string& name);
@@ -27,6 +44,7 @@ private:
 	string path;
 	string name;
 	bool open;
+	uint64_t iteration_ms;
 	struct crypt_device *cryptdevice;
 };
 
@@ -4,6 +4,9 @@
 
 #include <libutils/Logger.h>
 
+#include <algorithm>
+#include <cctype>
+
 using namespace Utils;
 
 namespace OPI
@@ -21,9 +24,121 @@ inline void throw_error(const Json::Value& rep)
 	}
 }
 
-Secop::Secop(): tid(0), secop("/tmp/secop")
+static atomic<bool> metrics_enabled(false);
+static mutex metrics_lock;
+static map<string, Secop::CommandMetrics> metrics;
+
+Secop::Secop(const string &path): tid(0), path(path),
+	secop( new UnixStreamClientSocket( path ) ),
+	connected(true), autoreconnect(false), sockauth(false), plainauth(false),
+	encoding(JsonEncoding), replysize(0)
+{
+
+}
+
+bool Secop::Reconnect()
+{
+	try
+	{
+		this->secop.reset( new UnixStreamClientSocket( this->path ) );
+	}
+	catch( std::exception& err )
+	{
+		logg << Logger::Error << "Failed to reconnect to secop: " << err.what() << lend;
+		this->connected = false;
+		return false;
+	}
+
+	this->framer.Clear();
+	this->connected = true;
+
+	// A new connection always starts out using json
+	Encoding encoding = this->encoding;
+	this->encoding = JsonEncoding;
+	this->framer.SetFraming( JsonHelper::StreamFramer::JsonFraming );
+
+	// Don't recurse into reconnect if restore fails
+	bool reconnect = this->autoreconnect;
+	this->autoreconnect = false;
+
+	bool ret = true;
+	if( this->sockauth )
+	{
+		ret = this->sockauth = this->SockAuth();
+	}
+
+	if( ret && encoding != JsonEncoding )
+	{
+		this->SetEncoding( encoding );
+	}
+
+	this->autoreconnect = reconnect;
+
+	return ret;
+}
+
+bool Secop::Connected()
+{
+	return this->connected;
+}
+
+bool Secop::SockAuthenticated()
+{
+	return this->sockauth && ! this->plainauth;
+}
+
+void Secop::SetAutoReconnect(bool reconnect)
+{
+	this->autoreconnect = reconnect;
+}
+
+bool Secop::SetEncoding(Secop::Encoding encoding)
 {
+	if( encoding == this->encoding )
+	{
+		return true;
+	}
+
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]		= "status";
+	cmd["encoding"]	= encoding == CborEncoding ? "cbor" : "json";
+
+	// Encoding is negotiated using protocol version 2
+	cmd["tid"]		= this->tid;
+	cmd["version"]	= 2.0;
+
+	// No trailing whitespace, next message might be binary
+	string r = this->Serialize( cmd );
+	while( r.size() > 0 && isspace( r.back() ) )
+	{
+		r.pop_back();
+	}
+
+	Json::Value rep;
+	if( ! ( this->Send( r ) && this->ReadReply( rep ) ) )
+	{
+		return false;
+	}
+
+	// Server without support replies without encoding, stay with current
+	if( ! this->CheckReply( rep ) || rep["encoding"].asString() != cmd["encoding"].asString() )
+	{
+		logg << Logger::Debug << "Secop encoding " << cmd["encoding"].asString() << " not supported" << lend;
+		return false;
+	}
+
+	this->encoding = encoding;
+	this->framer.SetFraming( encoding == CborEncoding ?
+								 JsonHelper::StreamFramer::LengthFraming :
+								 JsonHelper::StreamFramer::JsonFraming );
+
+	return true;
+}
 
+Secop::Encoding Secop::GetEncoding()
+{
+	return this->encoding;
 }
 
 bool Secop::Init(const string& pwd)
@@ -63,7 +178,9 @@ bool Secop::SockAuth()
 
 	Json::Value rep = this->DoCall(cmd);
 
-	return this->CheckReply(rep);
+	this->sockauth = this->CheckReply(rep);
+
+	return this->sockauth;
 }
 
 bool Secop::PlainAuth(const string& user, const string& pwd)
@@ -75,6 +192,9 @@ bool Secop::PlainAuth(const string& user, const string& pwd)
 	cmd["username"]	= user;
 	cmd["password"]	= pwd;
 
+	// Session identity is unknown after any attempt
+	this->plainauth = true;
+
 	Json::Value rep = this->DoCall(cmd);
 
 	return this->CheckReply(rep);
@@ -722,44 +842,1101 @@ bool Secop::AppHasACL(const string &appid, const string &acl)
 	return ret;
 }
 
-Secop::~Secop() = default;
+Secop::FlatResult Secop::GetIdentifiers(const vector<string> &users, const string &service)
+{
+	vector<Json::Value> cmds;
+	cmds.reserve( users.size() );
+	for( const string& user: users )
+	{
+		Json::Value cmd(Json::objectValue);
 
-Json::Value Secop::DoCall(Json::Value& cmd)
+		cmd["cmd"]			= "getidentifiers";
+		cmd["username"]		= user;
+		cmd["servicename"]	= service;
+
+		cmds.push_back( cmd );
+	}
+
+	vector<Json::Value> reps = this->DoCalls( cmds );
+
+	FlatResult ret;
+	for( size_t i = 0; i < users.size(); i++ )
+	{
+		bool ok = this->CheckReply( reps[i] );
+		uint32_t u = ret.AddUser( users[i], ok );
+
+		if( ! ok )
+		{
+			continue;
+		}
+
+		uint32_t record = 0;
+		for( const auto& id: reps[i]["identifiers"] )
+		{
+			for( auto it = id.begin(); it != id.end(); ++it )
+			{
+				ret.Add( u, record, it.key().asString(), (*it).asString() );
+			}
+			record++;
+		}
+	}
+
+	return ret;
+}
+
+Secop::FlatResult Secop::GetAttributes(const vector<string> &users)
 {
-	cmd["tid"]=this->tid;
-	cmd["version"]=1.0;
-	string r = this->writer.write( cmd );
+	vector<Json::Value> cmds;
+	cmds.reserve( users.size() );
+	for( const string& user: users )
+	{
+		Json::Value cmd(Json::objectValue);
 
-	this->secop.Write(r.c_str(), r.size() );
+		cmd["cmd"]		= "getattributes";
+		cmd["username"]	= user;
 
-	char buf[16384];
-	int rd;
+		cmds.push_back( cmd );
+	}
 
-	Json::Value resp;
+	vector<Json::Value> names = this->DoCalls( cmds );
 
-	if( ( rd = this->secop.Read( buf, sizeof(buf) ) ) > 0  )
+	// Second round, fetch values for all attributes of all users
+	cmds.clear();
+	vector<uint32_t> owner;
+	for( size_t i = 0; i < users.size(); i++ )
 	{
+		if( ! this->CheckReply( names[i] ) )
+		{
+			continue;
+		}
 
-		if( ! this->reader.parse( buf, buf+rd, resp ) )
+		for( const auto& attr: names[i]["attributes"] )
 		{
-			logg << Logger::Error << "Failed to parse response"<<lend;
+			Json::Value cmd(Json::objectValue);
+
+			cmd["cmd"]		= "getattribute";
+			cmd["username"]	= users[i];
+			cmd["attribute"]= attr.asString();
+
+			cmds.push_back( cmd );
+			owner.push_back( i );
 		}
+	}
+
+	vector<Json::Value> values = this->DoCalls( cmds );
 
+	FlatResult ret;
+	size_t v = 0;
+	for( size_t i = 0; i < users.size(); i++ )
+	{
+		uint32_t u = ret.AddUser( users[i], this->CheckReply( names[i] ) );
+
+		for( ; v < owner.size() && owner[v] == i; v++ )
+		{
+			if( this->CheckReply( values[v] ) )
+			{
+				ret.Add( u, 0, cmds[v]["attribute"].asString(), values[v]["attribute"].asString() );
+			}
+		}
 	}
 
-	return resp;
+	return ret;
 }
 
-bool Secop::CheckReply( const Json::Value& val )
+const vector<string> &Secop::FlatResult::Users() const
 {
-	bool ret = false;
+	return this->users;
+}
 
-	if( val.isMember("status") && val["status"].isObject() )
+bool Secop::FlatResult::Ok(size_t user) const
+{
+	return user < this->ok.size() && this->ok[user];
+}
+
+pair<size_t, size_t> Secop::FlatResult::Range(size_t user) const
+{
+	if( user >= this->first.size() )
 	{
-		ret = val["status"]["value"].asInt() == 0;
+		return make_pair( this->fields.size(), this->fields.size() );
+	}
+
+	size_t last = user + 1 < this->first.size() ? this->first[user + 1] : this->fields.size();
+
+	return make_pair( this->first[user], last );
+}
+
+size_t Secop::FlatResult::Size() const
+{
+	return this->fields.size();
+}
+
+const Secop::FlatResult::Field &Secop::FlatResult::operator[](size_t idx) const
+{
+	return this->fields[idx];
+}
+
+const char *Secop::FlatResult::Data() const
+{
+	return this->data.data();
+}
+
+string Secop::FlatResult::Key(size_t idx) const
+{
+	const Field& f = this->fields[idx];
+
+	return string( this->data.data() + f.key, f.keylen );
+}
+
+string Secop::FlatResult::Value(size_t idx) const
+{
+	const Field& f = this->fields[idx];
+
+	return string( this->data.data() + f.value, f.valuelen );
+}
+
+void Secop::FlatResult::Clear()
+{
+	this->users.clear();
+	this->ok.clear();
+	this->first.clear();
+	this->fields.clear();
+	this->data.clear();
+}
+
+uint32_t Secop::FlatResult::AddUser(const string &user, bool ok)
+{
+	this->users.push_back( user );
+	this->ok.push_back( ok );
+	this->first.push_back( this->fields.size() );
+
+	return this->users.size() - 1;
+}
+
+void Secop::FlatResult::Add(uint32_t user, uint32_t record, const string &key, const string &value)
+{
+	Field f;
+
+	f.user		= user;
+	f.record	= record;
+	f.key		= this->data.size();
+	f.keylen	= key.size();
+	this->data += key;
+	f.value		= this->data.size();
+	f.valuelen	= value.size();
+	this->data += value;
+
+	this->fields.push_back( f );
+}
+
+Secop::Batch::Batch(Secop &secop): secop(secop)
+{
+
+}
+
+size_t Secop::Batch::Add(const Json::Value &cmd)
+{
+	this->cmds.push_back( cmd );
+
+	return this->cmds.size() - 1;
+}
+
+size_t Secop::Batch::AddAttribute(const string &user, const string &attr, const string &value)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]		= "addattribute";
+	cmd["username"]	= user;
+	cmd["attribute"]= attr;
+	cmd["value"]= value;
+
+	return this->Add( cmd );
+}
+
+size_t Secop::Batch::AddService(const string &user, const string &service)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]			= "addservice";
+	cmd["username"]		= user;
+	cmd["servicename"]	= service;
+
+	return this->Add( cmd );
+}
+
+size_t Secop::Batch::AddACL(const string &user, const string &service, const string &acl)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]			= "addacl";
+	cmd["username"]		= user;
+	cmd["servicename"]	= service;
+	cmd["acl"]			= acl;
+
+	return this->Add( cmd );
+}
+
+size_t Secop::Batch::AddIdentifier(const string &user, const string &service, const map<string, string> &identifier)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]			= "addidentifier";
+	cmd["username"]		= user;
+	cmd["servicename"]	= service;
+
+	for(const auto& x: identifier)
+	{
+		cmd["identifier"][ x.first ] = x.second;
+	}
+
+	return this->Add( cmd );
+}
+
+size_t Secop::Batch::AddGroupMember(const string &group, const string &member)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]	= "groupaddmember";
+	cmd["group"]= group;
+	cmd["member"]= member;
+
+	return this->Add( cmd );
+}
+
+size_t Secop::Batch::AppAddACL(const string &appid, const string &acl)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]			= "addappacl";
+	cmd["appid"]		= appid;
+	cmd["acl"]			= acl;
+
+	return this->Add( cmd );
+}
+
+size_t Secop::Batch::AppAddIdentifier(const string &appid, const map<string, string> &identifier)
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]			= "addappidentifier";
+	cmd["appid"]		= appid;
+
+	for(const auto& x: identifier)
+	{
+		cmd["identifier"][ x.first ] = x.second;
+	}
+
+	return this->Add( cmd );
+}
+
+size_t Secop::Batch::Size()
+{
+	return this->cmds.size();
+}
+
+bool Secop::Batch::Execute()
+{
+	this->replies = this->secop.DoCalls( this->cmds );
+
+	bool ret = true;
+	for( const auto& rep: this->replies )
+	{
+		ret = ret && this->secop.CheckReply( rep );
 	}
 
 	return ret;
 }
 
+bool Secop::Batch::Ok(size_t idx)
+{
+	return this->secop.CheckReply( this->Reply( idx ) );
+}
+
+const Json::Value &Secop::Batch::Reply(size_t idx)
+{
+	if( idx >= this->replies.size() )
+	{
+		throw std::out_of_range("No reply for batch command");
+	}
+
+	return this->replies[idx];
+}
+
+void Secop::Batch::Clear()
+{
+	this->cmds.clear();
+	this->replies.clear();
+}
+
+Secop::Batch::~Batch() = default;
+
+Secop::~Secop() = default;
+
+Json::Value Secop::DoCall(Json::Value& cmd)
+{
+	bool measure = metrics_enabled.load( memory_order_relaxed );
+	chrono::steady_clock::time_point start;
+	if( measure )
+	{
+		start = chrono::steady_clock::now();
+	}
+
+	string r = this->Encode( cmd );
+
+	Json::Value resp;
+	this->replysize = 0;
+
+	/*
+	 * Only retry if the command never reached secop, once sent it
+	 * might have been applied and retrying could repeat a write.
+	 */
+	if( this->Send( r ) )
+	{
+		this->ReadReply( resp );
+	}
+	else if( this->autoreconnect && this->Reconnect() )
+	{
+		logg << Logger::Debug << "Retry call after reconnect to secop" << lend;
+		if( this->Send( r ) )
+		{
+			this->ReadReply( resp );
+		}
+	}
+
+	if( measure )
+	{
+		Secop::RecordMetrics( cmd["cmd"].asString(), r.size(), this->replysize,
+						chrono::steady_clock::now() - start, this->CheckReply( resp ) );
+	}
+
+	return resp;
+}
+
+vector<Json::Value> Secop::DoCalls(vector<Json::Value> &cmds)
+{
+	vector<Json::Value> resps( cmds.size() );
+	map<int, size_t> pending;
+
+	if( cmds.size() == 0 )
+	{
+		return resps;
+	}
+
+	bool measure = metrics_enabled.load( memory_order_relaxed );
+	chrono::steady_clock::time_point start;
+	if( measure )
+	{
+		start = chrono::steady_clock::now();
+	}
+
+	string r;
+	vector<size_t> reqsizes( cmds.size() ), repsizes( cmds.size() );
+	vector<chrono::steady_clock::duration> elapsed( cmds.size() );
+	for( size_t i = 0; i < cmds.size(); i++ )
+	{
+		pending[this->tid] = i;
+
+		size_t pos = r.size();
+		r += this->Encode( cmds[i] );
+		reqsizes[i] = r.size() - pos;
+		this->tid++;
+	}
+
+	if( ! this->Send( r ) )
+	{
+		if( ! ( this->autoreconnect && this->Reconnect() && this->Send( r ) ) )
+		{
+			return resps;
+		}
+	}
+
+	// Stale replies, i.e. left over from an earlier failed call, are skipped
+	while( pending.size() > 0 )
+	{
+		Json::Value resp;
+		if( ! this->ReadReply( resp ) )
+		{
+			break;
+		}
+
+		auto it = pending.end();
+		if( resp.isMember("tid") && resp["tid"].isInt() )
+		{
+			it = pending.find( resp["tid"].asInt() );
+		}
+
+		if( it == pending.end() )
+		{
+			logg << Logger::Notice << "Dropping secop reply with unknown tid" << lend;
+			continue;
+		}
+
+		size_t idx = it->second;
+		pending.erase( it );
+
+		resps[idx] = resp;
+		if( measure )
+		{
+			repsizes[idx] = this->replysize;
+			elapsed[idx] = chrono::steady_clock::now() - start;
+		}
+	}
+
+	if( measure )
+	{
+		for( size_t i = 0; i < cmds.size(); i++ )
+		{
+			Secop::RecordMetrics( cmds[i]["cmd"].asString(), reqsizes[i], repsizes[i],
+							resps[i].isNull() ? chrono::steady_clock::now() - start : elapsed[i],
+							this->CheckReply( resps[i] ) );
+		}
+	}
+
+	return resps;
+}
+
+bool Secop::ReadReply(Json::Value &resp)
+{
+	const char *start, *end;
+
+	while( ! this->framer.Next( start, end ) )
+	{
+		if( this->framer.Failed() )
+		{
+			// Can't find next message in stream, drop connection
+			logg << Logger::Error << "Invalid message frame from secop, closing connection" << lend;
+			this->secop.reset();
+			this->connected = false;
+			return false;
+		}
+
+		char* buf = this->framer.Reserve( 4096 );
+		int rd = 0;
+
+		try
+		{
+			rd = this->secop->Read( buf, this->framer.Space() );
+		}
+		catch( std::exception& err )
+		{
+			if( ! this->autoreconnect )
+			{
+				throw;
+			}
+			logg << Logger::Debug << "Failed to read from secop: " << err.what() << lend;
+		}
+
+		if( rd <= 0 )
+		{
+			this->connected = false;
+			return false;
+		}
+		this->framer.Commit( rd );
+	}
+
+	bool ret = this->encoding == CborEncoding ?
+				JsonHelper::FromCBOR( start, end, resp ) :
+				this->reader.parse( start, end, resp );
+	if( ! ret )
+	{
+		logg << Logger::Error << "Failed to parse response"<<lend;
+	}
+
+	this->replysize = end - start;
+	this->framer.Consume();
+
+	return ret;
+}
+
+string Secop::Encode(Json::Value &cmd)
+{
+	cmd["tid"]=this->tid;
+	cmd["version"]= this->encoding == CborEncoding ? 2.0 : 1.0;
+
+	return this->Serialize( cmd );
+}
+
+string Secop::Serialize(const Json::Value &cmd)
+{
+	if( this->encoding == CborEncoding )
+	{
+		return JsonHelper::ToCBORFrame( cmd );
+	}
+
+	return this->writer.write( cmd );
+}
+
+bool Secop::Send(const string &data)
+{
+	if( ! this->secop )
+	{
+		// Closed after a protocol error
+		if( ! this->autoreconnect )
+		{
+			throw runtime_error("Not connected to secop");
+		}
+		return false;
+	}
+
+	try
+	{
+		this->secop->Write( data.c_str(), data.size() );
+	}
+	catch( std::exception& err )
+	{
+		this->connected = false;
+		if( ! this->autoreconnect )
+		{
+			throw;
+		}
+		logg << Logger::Debug << "Failed to write to secop: " << err.what() << lend;
+		return false;
+	}
+
+	return true;
+}
+
+uint64_t Secop::CommandMetrics::Percentile(double p) const
+{
+	if( this->calls == 0 )
+	{
+		return 0;
+	}
+
+	uint64_t want = static_cast<uint64_t>( p * this->calls / 100.0 );
+	uint64_t seen = 0;
+	for( size_t i = 0; i < MetricsBuckets - 1; i++ )
+	{
+		seen += this->histogram[i];
+		if( seen > want )
+		{
+			return std::min( static_cast<uint64_t>( 1 ) << i, this->max_usecs );
+		}
+	}
+
+	return this->max_usecs;
+}
+
+void Secop::EnableMetrics(bool enable)
+{
+	metrics_enabled.store( enable, memory_order_relaxed );
+}
+
+bool Secop::MetricsEnabled()
+{
+	return metrics_enabled.load( memory_order_relaxed );
+}
+
+map<string, Secop::CommandMetrics> Secop::MetricsSnapshot()
+{
+	lock_guard<mutex> lock( metrics_lock );
+
+	return metrics;
+}
+
+Json::Value Secop::MetricsAsJson()
+{
+	Json::Value ret(Json::objectValue);
+
+	for( const auto& m: Secop::MetricsSnapshot() )
+	{
+		const CommandMetrics& cm = m.second;
+		Json::Value c(Json::objectValue);
+
+		c["calls"] = static_cast<Json::UInt64>( cm.calls );
+		c["errors"] = static_cast<Json::UInt64>( cm.errors );
+		c["request_bytes"] = static_cast<Json::UInt64>( cm.request_bytes );
+		c["reply_bytes"] = static_cast<Json::UInt64>( cm.reply_bytes );
+		c["total_us"] = static_cast<Json::UInt64>( cm.total_usecs );
+		c["avg_us"] = cm.calls ? static_cast<double>( cm.total_usecs ) / cm.calls : 0.0;
+		c["max_us"] = static_cast<Json::UInt64>( cm.max_usecs );
+		c["p50_us"] = static_cast<Json::UInt64>( cm.Percentile( 50 ) );
+		c["p99_us"] = static_cast<Json::UInt64>( cm.Percentile( 99 ) );
+
+		Json::Value hist(Json::arrayValue);
+		for( size_t i = 0; i < MetricsBuckets; i++ )
+		{
+			hist.append( static_cast<Json::UInt64>( cm.histogram[i] ) );
+		}
+		c["histogram"] = hist;
+
+		ret[m.first] = c;
+	}
+
+	return ret;
+}
+
+void Secop::ResetMetrics()
+{
+	lock_guard<mutex> lock( metrics_lock );
+
+	metrics.clear();
+}
+
+void Secop::RecordMetrics(const string &cmd, size_t reqsize, size_t repsize, chrono::steady_clock::duration elapsed, bool ok)
+{
+	uint64_t usecs = chrono::duration_cast<chrono::microseconds>( elapsed ).count();
+
+	size_t bucket = 0;
+	while( bucket < MetricsBuckets - 1 && ( static_cast<uint64_t>( 1 ) << bucket ) <= usecs )
+	{
+		bucket++;
+	}
+
+	lock_guard<mutex> lock( metrics_lock );
+
+	CommandMetrics& m = metrics[cmd];
+	m.calls++;
+	m.errors += ok ? 0 : 1;
+	m.request_bytes += reqsize;
+	m.reply_bytes += repsize;
+	m.total_usecs += usecs;
+	m.max_usecs = std::max( m.max_usecs, usecs );
+	m.histogram[bucket]++;
+}
+
+bool Secop::CheckReply( const Json::Value& val )
+{
+	bool ret = false;
+
+	if( val.isMember("status") && val["status"].isObject() )
+	{
+		ret = val["status"]["value"].asInt() == 0;
+	}
+
+	return ret;
+}
+
+/*
+ *
+ * Secop connection pool
+ *
+ */
+
+SecopPool::SecopPool(const string &path, size_t maxidle): path(path), state( new State )
+{
+	this->state->maxidle = maxidle;
+}
+
+SecopPool &SecopPool::Instance()
+{
+	static SecopPool pool;
+
+	return pool;
+}
+
+SecopPtr SecopPool::Get()
+{
+	Secop* s = nullptr;
+
+	{
+		lock_guard<mutex> lock(this->state->lock);
+
+		if( this->state->idle.size() > 0 )
+		{
+			s = this->state->idle.front().release();
+			this->state->idle.pop_front();
+		}
+	}
+
+	bool authenticated = true;
+	if( ! s )
+	{
+		s = new Secop( this->path );
+		s->SetAutoReconnect( true );
+
+		try
+		{
+			authenticated = s->SockAuth();
+		}
+		catch( ... )
+		{
+			delete s;
+			throw;
+		}
+	}
+
+	// Unauthenticated connections are not reused, next Get retries auth
+	weak_ptr<State> state( this->state );
+	return SecopPtr( s, [state, authenticated](Secop* s){ SecopPool::Release( state, s, authenticated ); } );
+}
+
+size_t SecopPool::Idle()
+{
+	lock_guard<mutex> lock(this->state->lock);
+
+	return this->state->idle.size();
+}
+
+void SecopPool::Clear()
+{
+	lock_guard<mutex> lock(this->state->lock);
+
+	this->state->idle.clear();
+}
+
+void SecopPool::Release(const weak_ptr<State>& state, Secop *s, bool reuse)
+{
+	unique_ptr<Secop> conn( s );
+
+	// Never hand a user authenticated session to another caller
+	if( ! reuse || ! conn->Connected() || ! conn->SockAuthenticated() )
+	{
+		return;
+	}
+
+	shared_ptr<State> st = state.lock();
+	if( ! st )
+	{
+		// Pool is gone
+		return;
+	}
+
+	lock_guard<mutex> lock(st->lock);
+
+	if( st->idle.size() < st->maxidle )
+	{
+		st->idle.push_back( std::move( conn ) );
+	}
+}
+
+SecopPool::~SecopPool() = default;
+
+/*
+ *
+ * Secop query cache
+ *
+ */
+
+static inline string cache_key(const string& a, const string& b = "", const string& c = "")
+{
+	string key;
+
+	key.reserve( a.size() + b.size() + c.size() + 2 );
+	key.append( a ).append( 1, '\0' ).append( b ).append( 1, '\0' ).append( c );
+
+	return key;
+}
+
+template<typename T>
+bool SecopCache::Lookup(unordered_map<string, Entry<T> > &cache, const string &key, T &value)
+{
+	auto it = cache.find( key );
+
+	if( it == cache.end() )
+	{
+		return false;
+	}
+
+	if( it->second.expires < chrono::steady_clock::now() )
+	{
+		cache.erase( it );
+		return false;
+	}
+
+	value = it->second.value;
+
+	return true;
+}
+
+template<typename T>
+void SecopCache::Store(unordered_map<string, Entry<T> > &cache, const string &key, const T &value, unsigned long generation)
+{
+	lock_guard<mutex> lock(this->lock);
+
+	// Don't store result if cache was modified during query
+	if( generation == this->generation )
+	{
+		cache[ key ] = { value, chrono::steady_clock::now() + this->ttl };
+	}
+}
+
+template<typename T>
+void SecopCache::Erase(unordered_map<string, Entry<T> > &cache, const string &prefix)
+{
+	for( auto it = cache.begin(); it != cache.end(); )
+	{
+		if( it->first.compare( 0, prefix.size(), prefix ) == 0 )
+		{
+			it = cache.erase( it );
+		}
+		else
+		{
+			it++;
+		}
+	}
+}
+
+SecopCache::SecopCache(unsigned int ttl, SecopPool &pool): pool(pool), ttl(ttl), generation(0)
+{
+
+}
+
+bool SecopCache::HasACL(const string &user, const string &service, const string &acl)
+{
+	string key = cache_key( user, service, acl );
+	bool ret;
+	unsigned long gen;
+
+	{
+		lock_guard<mutex> lock(this->lock);
+		if( this->Lookup( this->acls, key, ret ) )
+		{
+			return ret;
+		}
+		gen = this->generation;
+	}
+
+	ret = this->pool.Get()->HasACL( user, service, acl );
+
+	this->Store( this->acls, key, ret, gen );
+
+	return ret;
+}
+
+bool SecopCache::AppHasACL(const string &appid, const string &acl)
+{
+	string key = cache_key( appid, acl );
+	bool ret;
+	unsigned long gen;
+
+	{
+		lock_guard<mutex> lock(this->lock);
+		if( this->Lookup( this->appacls, key, ret ) )
+		{
+			return ret;
+		}
+		gen = this->generation;
+	}
+
+	ret = this->pool.Get()->AppHasACL( appid, acl );
+
+	this->Store( this->appacls, key, ret, gen );
+
+	return ret;
+}
+
+vector<string> SecopCache::GetUserGroups(const string &user)
+{
+	string key = cache_key( user );
+	vector<string> ret;
+	unsigned long gen;
+
+	{
+		lock_guard<mutex> lock(this->lock);
+		if( this->Lookup( this->usergroups, key, ret ) )
+		{
+			return ret;
+		}
+		gen = this->generation;
+	}
+
+	ret = this->pool.Get()->GetUserGroups( user );
+
+	this->Store( this->usergroups, key, ret, gen );
+
+	return ret;
+}
+
+vector<string> SecopCache::GetGroupMembers(const string &group)
+{
+	string key = cache_key( group );
+	vector<string> ret;
+	unsigned long gen;
+
+	{
+		lock_guard<mutex> lock(this->lock);
+		if( this->Lookup( this->groupmembers, key, ret ) )
+		{
+			return ret;
+		}
+		gen = this->generation;
+	}
+
+	ret = this->pool.Get()->GetGroupMembers( group );
+
+	this->Store( this->groupmembers, key, ret, gen );
+
+	return ret;
+}
+
+bool SecopCache::RemoveUser(const string &user)
+{
+	bool ret = this->pool.Get()->RemoveUser( user );
+
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	this->Erase( this->acls, user + '\0' );
+	this->usergroups.erase( cache_key( user ) );
+
+	// Secop might still have the user, leave the lists alone then
+	if( ret )
+	{
+		for( auto& members: this->groupmembers )
+		{
+			vector<string>& v = members.second.value;
+			v.erase( std::remove( v.begin(), v.end(), user ), v.end() );
+		}
+	}
+
+	return ret;
+}
+
+bool SecopCache::RemoveService(const string &user, const string &service)
+{
+	bool ret = this->pool.Get()->RemoveService( user, service );
+
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	// All acls of service goes with it
+	this->Erase( this->acls, user + '\0' + service + '\0' );
+
+	return ret;
+}
+
+bool SecopCache::AddACL(const string &user, const string &service, const string &acl)
+{
+	bool ret = this->pool.Get()->AddACL( user, service, acl );
+
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	if( ret )
+	{
+		this->acls[ cache_key( user, service, acl ) ] = { true, chrono::steady_clock::now() + this->ttl };
+	}
+
+	return ret;
+}
+
+bool SecopCache::RemoveACL(const string &user, const string &service, const string &acl)
+{
+	bool ret = this->pool.Get()->RemoveACL( user, service, acl );
+
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	if( ret )
+	{
+		this->acls[ cache_key( user, service, acl ) ] = { false, chrono::steady_clock::now() + this->ttl };
+	}
+	else
+	{
+		this->acls.erase( cache_key( user, service, acl ) );
+	}
+
+	return ret;
+}
+
+bool SecopCache::AddGroupMember(const string &group, const string &member)
+{
+	bool ret = this->pool.Get()->AddGroupMember( group, member );
+
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	// Group membership might affect acls of member
+	this->groupmembers.erase( cache_key( group ) );
+	this->usergroups.erase( cache_key( member ) );
+	this->Erase( this->acls, member + '\0' );
+
+	return ret;
+}
+
+bool SecopCache::RemoveGroupMember(const string &group, const string &member)
+{
+	bool ret = this->pool.Get()->RemoveGroupMember( group, member );
+
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	this->groupmembers.erase( cache_key( group ) );
+	this->usergroups.erase( cache_key( member ) );
+	this->Erase( this->acls, member + '\0' );
+
+	return ret;
+}
+
+bool SecopCache::RemoveGroup(const string &group)
+{
+	bool ret = this->pool.Get()->RemoveGroup( group );
+
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	// Members unknown, drop everything that could depend on group
+	this->groupmembers.erase( cache_key( group ) );
+	this->usergroups.clear();
+	this->acls.clear();
+
+	return ret;
+}
+
+bool SecopCache::AppRemoveID(const string &appid)
+{
+	bool ret = this->pool.Get()->AppRemoveID( appid );
+
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	this->Erase( this->appacls, appid + '\0' );
+
+	return ret;
+}
+
+bool SecopCache::AppAddACL(const string &appid, const string &acl)
+{
+	bool ret = this->pool.Get()->AppAddACL( appid, acl );
+
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	if( ret )
+	{
+		this->appacls[ cache_key( appid, acl ) ] = { true, chrono::steady_clock::now() + this->ttl };
+	}
+
+	return ret;
+}
+
+bool SecopCache::AppRemoveACL(const string &appid, const string &acl)
+{
+	bool ret = this->pool.Get()->AppRemoveACL( appid, acl );
+
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	if( ret )
+	{
+		this->appacls[ cache_key( appid, acl ) ] = { false, chrono::steady_clock::now() + this->ttl };
+	}
+	else
+	{
+		this->appacls.erase( cache_key( appid, acl ) );
+	}
+
+	return ret;
+}
+
+void SecopCache::SetTTL(unsigned int ttl)
+{
+	lock_guard<mutex> lock(this->lock);
+
+	this->ttl = chrono::seconds( ttl );
+}
+
+void SecopCache::Flush()
+{
+	lock_guard<mutex> lock(this->lock);
+	this->generation++;
+
+	this->acls.clear();
+	this->appacls.clear();
+	this->usergroups.clear();
+	this->groupmembers.clear();
+}
+
+SecopCache::~SecopCache() = default;
+
 } // End NS
@@ -5,9 +5,18 @@
 #include <libutils/ClassTools.h>
 #include <json/json.h>
 
+#include "JsonHelper.h"
+
 #include <string>
 #include <list>
 #include <map>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 using namespace std;
 using namespace Utils::Net;
@@ -20,6 +29,8 @@ namespace OPI
 #define INITIALIZED		0x02
 #define AUTHENTICATED	0x04
 
+#define SECOP_SOCKET	"/tmp/secop"
+
 
 class Secop: public Utils::NoCopy
 {
@@ -31,7 +42,29 @@ public:
 		Authenticated	= 0x04
 	};
 
-	Secop();
+	Secop(const string& path = SECOP_SOCKET);
+
+	/* Reconnect to secop, socket authentication is restored if used */
+	bool Reconnect();
+	bool Connected();
+
+	/* True if authenticated using SockAuth only, not as a user */
+	bool SockAuthenticated();
+
+	/* Transparently reconnect and retry once if connection is lost */
+	void SetAutoReconnect(bool reconnect);
+
+	enum Encoding {
+		JsonEncoding,
+		CborEncoding
+	};
+
+	/*
+	 * Negotiate wire encoding with secop using protocol version 2.
+	 * Returns false, and keeps current encoding, if not supported.
+	 */
+	bool SetEncoding(Encoding encoding);
+	Encoding GetEncoding();
 
 	bool Init(const string& pwd);
 
@@ -92,23 +125,265 @@ public:
 	bool AppRemoveACL(const string& appid, const string& acl);
 	bool AppHasACL(const string& appid, const string& acl);
 
+	/*
+	 * Flat result of bulk user queries.
+	 *
+	 * All keys and values are stored back to back in one buffer and
+	 * referenced by offset from a contiguous field array. Fields are
+	 * ordered by user, and within a user by record. Record is the
+	 * identifier index for identifiers and always 0 for attributes.
+	 */
+	class FlatResult
+	{
+	public:
+		struct Field {
+			uint32_t user;
+			uint32_t record;
+			uint32_t key;
+			uint32_t keylen;
+			uint32_t value;
+			uint32_t valuelen;
+		};
+
+		const vector<string>& Users() const;
+
+		/* False if secop rejected the query for user, i.e. no such user */
+		bool Ok(size_t user) const;
+
+		/* Fields belonging to user, [first, last) */
+		pair<size_t, size_t> Range(size_t user) const;
+
+		size_t Size() const;
+		const Field& operator[](size_t idx) const;
+
+		const char* Data() const;
+		string Key(size_t idx) const;
+		string Value(size_t idx) const;
+
+		void Clear();
+	private:
+		friend class Secop;
+
+		uint32_t AddUser(const string& user, bool ok);
+		void Add(uint32_t user, uint32_t record, const string& key, const string& value);
+
+		vector<string> users;
+		vector<bool> ok;
+		vector<size_t> first;
+		vector<Field> fields;
+		string data;
+	};
+
+	/*
+	 * Bulk fetch for many users, all queries are pipelined on the
+	 * connection instead of doing one round trip per user. Failing
+	 * users are flagged in the result rather than throwing.
+	 */
+	FlatResult GetIdentifiers(const vector<string>& users, const string& service);
+
+	/* Attribute names and values, two round trips in total */
+	FlatResult GetAttributes(const vector<string>& users);
+
+	/*
+	 * Batch, queue a number of commands and send them to secop
+	 * in one write. Replies are matched to commands using tid.
+	 */
+	class Batch: public Utils::NoCopy
+	{
+	public:
+		Batch(Secop& secop);
+
+		/* Queue a raw command, returns index of command in batch */
+		size_t Add(const Json::Value& cmd);
+
+		size_t AddAttribute(const string& user, const string& attr, const string& value);
+		size_t AddService(const string& user, const string& service);
+		size_t AddACL(const string& user, const string& service, const string& acl);
+		size_t AddIdentifier(const string& user, const string& service, const map<string,string>& identifier);
+		size_t AddGroupMember(const string& group, const string& member);
+		size_t AppAddACL(const string& appid, const string& acl);
+		size_t AppAddIdentifier(const string& appid, const map<string,string>& identifier);
+
+		size_t Size();
+
+		/* Send all queued commands, returns true if all succeeded */
+		bool Execute();
+
+		bool Ok(size_t idx);
+		const Json::Value& Reply(size_t idx);
+
+		void Clear();
+
+		virtual ~Batch();
+	private:
+		Secop& secop;
+		vector<Json::Value> cmds;
+		vector<Json::Value> replies;
+	};
+
+	/*
+	 * Opt in, process wide, per command instrumentation.
+	 *
+	 * Latency histogram bucket n counts calls that took less
+	 * than 2^n us, the last bucket holds everything slower.
+	 */
+	static const size_t MetricsBuckets = 24;
+
+	struct CommandMetrics {
+		uint64_t calls = 0;
+		uint64_t errors = 0;
+		uint64_t request_bytes = 0;
+		uint64_t reply_bytes = 0;
+		uint64_t total_usecs = 0;
+		uint64_t max_usecs = 0;
+		uint64_t histogram[MetricsBuckets] = {};
+
+		/* Estimate from histogram, upper bound of bucket */
+		uint64_t Percentile(double p) const;
+	};
+
+	static void EnableMetrics(bool enable);
+	static bool MetricsEnabled();
+	static map<string, CommandMetrics> MetricsSnapshot();
+	static Json::Value MetricsAsJson();
+	static void ResetMetrics();
 
 	virtual ~Secop();
 
 protected:
 	Json::Value DoCall(Json::Value& cmd);
+	vector<Json::Value> DoCalls(vector<Json::Value>& cmds);
+	bool ReadReply(Json::Value& resp);
+	bool Send(const string& data);
+	string Encode(Json::Value& cmd);
+	string Serialize(const Json::Value& cmd);
 
 	bool CheckReply( const Json::Value& val );
 
+	static void RecordMetrics(const string& cmd, size_t reqsize, size_t repsize,
+							  chrono::steady_clock::duration elapsed, bool ok);
+
 	int tid;
 private:
-	UnixStreamClientSocket secop;
+	string path;
+	unique_ptr<UnixStreamClientSocket> secop;
+	bool connected;
+	bool autoreconnect;
+	bool sockauth;
+	bool plainauth;
+	Encoding encoding;
+	size_t replysize;
 	Json::FastWriter writer;
 	Json::Reader reader;
+	JsonHelper::StreamFramer framer;
 };
 
 typedef shared_ptr<Secop> SecopPtr;
 
+/*
+ * Process wide pool of socket authenticated secop connections.
+ *
+ * Connections are checked out with Get and returned to the pool
+ * when the last reference is released. Pooled connections reconnect
+ * transparently if secop is restarted. Connections released after
+ * the pool is destroyed are closed.
+ */
+class SecopPool: public Utils::NoCopy
+{
+public:
+	SecopPool(const string& path = SECOP_SOCKET, size_t maxidle = 4);
+
+	static SecopPool& Instance();
+
+	/*
+	 * Check out a socket authenticated connection. Pooled connections
+	 * are shared between unrelated callers and must not be
+	 * re-authenticated, i.e. using PlainAuth. Connections that are
+	 * anyway are closed on release instead of being reused.
+	 */
+	SecopPtr Get();
+
+	size_t Idle();
+	void Clear();
+
+	virtual ~SecopPool();
+private:
+	/* Shared with checked out connections, which may outlive the pool */
+	struct State {
+		size_t maxidle;
+		mutex lock;
+		list<unique_ptr<Secop>> idle;
+	};
+
+	static void Release(const weak_ptr<State>& state, Secop* s, bool reuse);
+
+	string path;
+	shared_ptr<State> state;
+};
+
+/*
+ * Caching front for the read queries on the authorization path.
+ *
+ * Results of HasACL, AppHasACL, GetUserGroups and GetGroupMembers are
+ * kept for ttl seconds. Writes made through the cache update or
+ * invalidate affected entries, changes made by others are seen after
+ * ttl has passed or after a Flush.
+ */
+class SecopCache: public Utils::NoCopy
+{
+public:
+	SecopCache(unsigned int ttl = 30, SecopPool& pool = SecopPool::Instance());
+
+	// Cached queries
+	bool HasACL(const string& user, const string& service, const string& acl);
+	bool AppHasACL(const string& appid, const string& acl);
+	vector<string> GetUserGroups(const string& user);
+	vector<string> GetGroupMembers(const string& group);
+
+	// Write through
+	bool RemoveUser(const string& user);
+	bool RemoveService(const string& user, const string& service);
+	bool AddACL(const string& user, const string& service, const string& acl);
+	bool RemoveACL(const string& user, const string& service, const string& acl);
+	bool AddGroupMember(const string& group, const string& member);
+	bool RemoveGroupMember(const string& group, const string& member);
+	bool RemoveGroup(const string& group);
+	bool AppRemoveID(const string& appid);
+	bool AppAddACL(const string& appid, const string& acl);
+	bool AppRemoveACL(const string& appid, const string& acl);
+
+	void SetTTL(unsigned int ttl);
+	void Flush();
+
+	virtual ~SecopCache();
+private:
+	template<typename T>
+	struct Entry
+	{
+		T value;
+		chrono::steady_clock::time_point expires;
+	};
+
+	template<typename T>
+	bool Lookup(unordered_map<string, Entry<T>>& cache, const string& key, T& value);
+
+	template<typename T>
+	void Store(unordered_map<string, Entry<T>>& cache, const string& key, const T& value, unsigned long generation);
+
+	template<typename T>
+	void Erase(unordered_map<string, Entry<T>>& cache, const string& prefix);
+
+	SecopPool& pool;
+	chrono::seconds ttl;
+	unsigned long generation;
+	mutex lock;
+
+	unordered_map<string, Entry<bool>> acls;
+	unordered_map<string, Entry<bool>> appacls;
+	unordered_map<string, Entry<vector<string>>> usergroups;
+	unordered_map<string, Entry<vector<string>>> groupmembers;
+};
+
 } // End NS
 
 #endif // SECOP_H
@@ -0,0 +1,257 @@
+#include "SecureArena.h"
+
+#include <libutils/Logger.h>
+
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace Utils;
+
+namespace OPI {
+namespace CryptoHelper {
+
+/* Zeroize, the barrier keeps the compiler from dropping the memset */
+static void wipe(void* p, size_t len)
+{
+	memset( p, 0, len );
+	__asm__ __volatile__( "" : : "r"( p ) : "memory" );
+}
+
+static size_t pagesize()
+{
+	static size_t page = sysconf( _SC_PAGESIZE );
+
+	return page;
+}
+
+static size_t class_size(size_t idx)
+{
+	return SecureArena::MinClassSize << idx;
+}
+
+SecureArena &SecureArena::Instance()
+{
+	// Never destroyed, static objects may release memory during exit
+	static SecureArena* arena = new SecureArena;
+
+	return *arena;
+}
+
+void *SecureArena::Allocate(size_t size)
+{
+	if( size == 0 )
+	{
+		return nullptr;
+	}
+
+	lock_guard<mutex> lock( this->lock );
+
+	void* ret;
+	size_t used;
+
+	if( size > MaxClassSize )
+	{
+		bool locked;
+		used = ( size + pagesize() - 1 ) / pagesize() * pagesize();
+		ret = this->Map( used, locked );
+		this->large[ret] = locked;
+		if( ! locked )
+		{
+			this->LockFailed();
+		}
+		this->stats.large++;
+	}
+	else
+	{
+		size_t idx = SecureArena::ClassIndex( size );
+
+		if( ! this->freelist[idx] )
+		{
+			this->Refill( idx );
+		}
+
+		FreeSlot* slot = this->freelist[idx];
+		this->freelist[idx] = slot->next;
+		slot->next = nullptr;
+
+		ret = slot;
+		used = class_size( idx );
+		this->classinuse[idx]++;
+	}
+
+	this->stats.inuse += used;
+	this->stats.peak = max( this->stats.peak, this->stats.inuse );
+	this->stats.allocations++;
+	this->stats.total++;
+
+	return ret;
+}
+
+void SecureArena::Release(void *p, size_t size)
+{
+	if( p == nullptr || size == 0 )
+	{
+		return;
+	}
+
+	lock_guard<mutex> lock( this->lock );
+
+	if( size > MaxClassSize )
+	{
+		size_t used = ( size + pagesize() - 1 ) / pagesize() * pagesize();
+
+		wipe( p, used );
+
+		auto it = this->large.find( p );
+		bool locked = it != this->large.end() && it->second;
+		if( it != this->large.end() )
+		{
+			this->large.erase( it );
+		}
+		this->Unmap( p, used, locked );
+
+		this->stats.inuse -= used;
+		this->stats.large--;
+	}
+	else
+	{
+		size_t idx = SecureArena::ClassIndex( size );
+
+		wipe( p, class_size( idx ) );
+
+		FreeSlot* slot = static_cast<FreeSlot*>( p );
+		slot->next = this->freelist[idx];
+		this->freelist[idx] = slot;
+
+		this->stats.inuse -= class_size( idx );
+		this->classinuse[idx]--;
+	}
+
+	this->stats.allocations--;
+}
+
+SecureArena::Stats SecureArena::GetStats()
+{
+	lock_guard<mutex> lock( this->lock );
+
+	Stats ret = this->stats;
+	for( size_t i = 0; i < Classes; i++ )
+	{
+		ret.classes[ class_size( i ) ] = this->classinuse[i];
+	}
+
+	return ret;
+}
+
+SecureArena::SecureArena(): freelist(), classinuse(), slab(nullptr), slabfree(0),
+	lockwarned(false), stats()
+{
+}
+
+size_t SecureArena::ClassIndex(size_t size)
+{
+	size_t idx = 0;
+	while( class_size( idx ) < size )
+	{
+		idx++;
+	}
+
+	return idx;
+}
+
+void *SecureArena::Map(size_t size, bool& locked)
+{
+	void* p = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if( p == MAP_FAILED )
+	{
+		throw bad_alloc();
+	}
+
+	// Keep out of swap and core dumps
+	locked = mlock( p, size ) == 0;
+	if( locked )
+	{
+		this->stats.locked += size;
+	}
+#ifdef MADV_DONTDUMP
+	madvise( p, size, MADV_DONTDUMP );
+#endif
+
+	this->stats.mapped += size;
+
+	return p;
+}
+
+void SecureArena::Unmap(void *p, size_t size, bool locked)
+{
+	if( locked )
+	{
+		munlock( p, size );
+		this->stats.locked -= size;
+	}
+	munmap( p, size );
+
+	this->stats.mapped -= size;
+}
+
+void SecureArena::LockFailed()
+{
+	if( ! this->lockwarned )
+	{
+		this->lockwarned = true;
+		logg << Logger::Notice << "Secure memory could not be locked, RLIMIT_MEMLOCK too low" << lend;
+	}
+}
+
+void SecureArena::NewSlab()
+{
+	bool locked;
+	size_t size = SlabSize;
+	char* p = static_cast<char*>( this->Map( size, locked ) );
+
+	size_t minsize = pagesize() > MaxClassSize ? pagesize() : MaxClassSize;
+	if( ! locked && size > minsize )
+	{
+		// Limit reached, what is left might still fit a smaller slab
+		this->Unmap( p, size, false );
+		size = minsize;
+		p = static_cast<char*>( this->Map( size, locked ) );
+	}
+
+	if( ! locked )
+	{
+		this->LockFailed();
+	}
+
+	// Tail of previous slab, if any, is smaller than a chunk and left unused
+	this->slab = p;
+	this->slabfree = size;
+}
+
+void SecureArena::Refill(size_t idx)
+{
+	if( this->slabfree < MaxClassSize )
+	{
+		this->NewSlab();
+	}
+
+	char* chunk = this->slab;
+	this->slab += MaxClassSize;
+	this->slabfree -= MaxClassSize;
+
+	size_t size = class_size( idx );
+
+	// Push in reverse to hand out slots in address order
+	for( size_t off = MaxClassSize; off >= size; off -= size )
+	{
+		FreeSlot* slot = reinterpret_cast<FreeSlot*>( chunk + off - size );
+		slot->next = this->freelist[idx];
+		this->freelist[idx] = slot;
+	}
+}
+
+}
+}
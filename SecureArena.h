@@ -0,0 +1,169 @@
+#ifndef SECUREARENA_H
+#define SECUREARENA_H
+
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace OPI {
+namespace CryptoHelper {
+
+/*
+ * Pool of locked memory for key material and passwords.
+ *
+ * Small allocations are served from size classes, powers of two
+ * between MinClassSize and MaxClassSize. Slabs that are mlock'ed and
+ * excluded from core dumps are shared by all classes, each class is
+ * given MaxClassSize sized chunks of a slab as needed. Larger
+ * allocations get a locked mapping of their own. Memory is zeroized
+ * when released and kept for reuse, avoiding malloc churn.
+ *
+ * Locking needs RLIMIT_MEMLOCK to cover the slabs in use, SlabSize
+ * for typical use, plus large allocations. That fits the common
+ * 64 KiB default. When a slab can not be locked a single chunk is
+ * tried instead. Locking is still best effort, memory over the limit
+ * is handed out but not counted as locked in the stats, and a notice
+ * is logged the first time it happens.
+ */
+class SecureArena
+{
+public:
+	static const size_t MinClassSize = 16;
+	static const size_t MaxClassSize = 4096;
+	static const size_t SlabSize = 64 * 1024;
+
+	struct Stats {
+		size_t inuse;		// Bytes handed out, rounded up to size class
+		size_t peak;		// Max of inuse
+		size_t allocations;	// Live allocations
+		size_t total;		// Allocations made in total
+		size_t large;		// Live allocations above MaxClassSize
+		size_t mapped;		// Bytes mapped for slabs and large allocations
+		size_t locked;		// Bytes of mapped successfully locked
+		std::map<size_t, size_t> classes;	// Live allocations per size class
+	};
+
+	static SecureArena& Instance();
+
+	void* Allocate(size_t size);
+	void Release(void* p, size_t size);
+
+	Stats GetStats();
+
+private:
+	static const size_t Classes = 9;
+
+	struct FreeSlot {
+		FreeSlot* next;
+	};
+
+	SecureArena();
+	SecureArena(const SecureArena&) = delete;
+	SecureArena& operator=(const SecureArena&) = delete;
+
+	static size_t ClassIndex(size_t size);
+	void* Map(size_t size, bool& locked);
+	void Unmap(void* p, size_t size, bool locked);
+	void LockFailed();
+	void NewSlab();
+	void Refill(size_t idx);
+
+	std::mutex lock;
+	FreeSlot* freelist[Classes];
+	size_t classinuse[Classes];
+	std::map<void*, bool> large;	// Large allocations, if locked
+	char* slab;						// Unused part of current slab
+	size_t slabfree;
+	bool lockwarned;
+	Stats stats;
+};
+
+/*
+ * Standard allocator on top of the arena. Provides the full pre C++11
+ * interface as well since the old string ABI requires it.
+ */
+template<class T>
+class SecureAllocator
+{
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template<class U>
+	struct rebind
+	{
+		typedef SecureAllocator<U> other;
+	};
+
+	SecureAllocator() noexcept {}
+
+	template<class U>
+	SecureAllocator(const SecureAllocator<U>&) noexcept {}
+
+	pointer address(reference x) const noexcept
+	{
+		return &x;
+	}
+
+	const_pointer address(const_reference x) const noexcept
+	{
+		return &x;
+	}
+
+	pointer allocate(size_type n, const void* = nullptr)
+	{
+		if( n > this->max_size() )
+		{
+			throw std::bad_alloc();
+		}
+
+		return static_cast<pointer>( SecureArena::Instance().Allocate( n * sizeof( T ) ) );
+	}
+
+	void deallocate(pointer p, size_type n)
+	{
+		SecureArena::Instance().Release( p, n * sizeof( T ) );
+	}
+
+	size_type max_size() const noexcept
+	{
+		return std::numeric_limits<size_type>::max() / sizeof( T );
+	}
+
+	template<class U, class... Args>
+	void construct(U* p, Args&&... args)
+	{
+		::new( (void*) p ) U( std::forward<Args>( args )... );
+	}
+
+	template<class U>
+	void destroy(U* p)
+	{
+		p->~U();
+	}
+};
+
+template<class T, class U>
+bool operator==(const SecureAllocator<T>&, const SecureAllocator<U>&) noexcept
+{
+	return true;
+}
+
+template<class T, class U>
+bool operator!=(const SecureAllocator<T>&, const SecureAllocator<U>&) noexcept
+{
+	return false;
+}
+
+}
+}
+
+#endif // SECUREARENA_H
@@ -0,0 +1,266 @@
+#include "X509Builder.h"
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/x509v3.h>
+
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+
+namespace OPI {
+namespace X509Builder {
+
+template<class T, void(*F)(T*)>
+struct SSLFree
+{
+	void operator()(T* p) const
+	{
+		F( p );
+	}
+};
+
+typedef unique_ptr<BIO, SSLFree<BIO, BIO_free_all>> BIOPtr;
+typedef unique_ptr<EVP_PKEY, SSLFree<EVP_PKEY, EVP_PKEY_free>> EVP_PKEYPtr;
+typedef unique_ptr<X509, SSLFree<X509, X509_free>> X509Ptr;
+typedef unique_ptr<X509_REQ, SSLFree<X509_REQ, X509_REQ_free>> X509_REQPtr;
+typedef unique_ptr<X509_EXTENSION, SSLFree<X509_EXTENSION, X509_EXTENSION_free>> X509_EXTENSIONPtr;
+typedef unique_ptr<BIGNUM, SSLFree<BIGNUM, BN_free>> BIGNUMPtr;
+
+[[noreturn]] static void ssl_error(const string& msg)
+{
+	char buf[256] = {};
+
+	unsigned long err = ERR_get_error();
+	ERR_clear_error();
+
+	if( err != 0 )
+	{
+		ERR_error_string_n( err, buf, sizeof( buf ) );
+		throw runtime_error( msg + ": " + buf );
+	}
+
+	throw runtime_error( msg );
+}
+
+static EVP_PKEYPtr ssl_loadkey(const string& pem)
+{
+	BIOPtr bio( BIO_new_mem_buf( pem.data(), pem.size() ) );
+	if( ! bio )
+	{
+		ssl_error("Failed to allocate buffer");
+	}
+
+	EVP_PKEYPtr key( PEM_read_bio_PrivateKey( bio.get(), nullptr, nullptr, nullptr ) );
+	if( ! key )
+	{
+		ssl_error("Failed to read private key");
+	}
+
+	return key;
+}
+
+static const EVP_MD* ssl_digest(const string& digest)
+{
+	const EVP_MD* md = EVP_get_digestbyname( digest.c_str() );
+	if( ! md )
+	{
+		throw runtime_error("Unknown digest "+digest);
+	}
+
+	return md;
+}
+
+static void ssl_setname(X509_NAME* name, const string& cn, const string& company)
+{
+	if( company != "" &&
+			! X509_NAME_add_entry_by_txt( name, "O", MBSTRING_UTF8, (const unsigned char*) company.c_str(), -1, -1, 0 ) )
+	{
+		ssl_error("Failed to set organization");
+	}
+
+	if( cn != "" &&
+			! X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_UTF8, (const unsigned char*) cn.c_str(), -1, -1, 0 ) )
+	{
+		ssl_error("Failed to set common name");
+	}
+}
+
+static X509_EXTENSIONPtr ssl_extension(X509V3_CTX* ctx, int nid, const string& value)
+{
+	X509_EXTENSIONPtr ext( X509V3_EXT_conf_nid( nullptr, ctx, nid, value.c_str() ) );
+	if( ! ext )
+	{
+		ssl_error("Failed to create extension "+value);
+	}
+
+	return ext;
+}
+
+static string ssl_sanlist(const vector<string>& san)
+{
+	string ret;
+	for( const string& name: san )
+	{
+		if( ret != "" )
+		{
+			ret += ",";
+		}
+		ret += name;
+	}
+
+	return ret;
+}
+
+/* Function constness differs between openssl versions, hence templates */
+template<class T, class PEMFunc, class DERFunc>
+static void ssl_export(T* obj, PEMFunc topem, DERFunc toder, string& pem, vector<unsigned char>& der)
+{
+	BIOPtr bio( BIO_new( BIO_s_mem() ) );
+	if( ! bio || ! topem( bio.get(), obj ) )
+	{
+		ssl_error("Failed to PEM encode");
+	}
+
+	char* data = nullptr;
+	long len = BIO_get_mem_data( bio.get(), &data );
+	pem.assign( data, len );
+
+	int dlen = toder( obj, nullptr );
+	if( dlen <= 0 )
+	{
+		ssl_error("Failed to DER encode");
+	}
+
+	der.resize( dlen );
+	unsigned char* p = &der[0];
+	if( toder( obj, &p ) != dlen )
+	{
+		ssl_error("Failed to DER encode");
+	}
+}
+
+void CSR(const string &keypem, const string &cn, const string &company, const string &digest, const vector<string> &san, string &pem, vector<unsigned char> &der)
+{
+	EVP_PKEYPtr key = ssl_loadkey( keypem );
+	const EVP_MD* md = ssl_digest( digest );
+
+	X509_REQPtr req( X509_REQ_new() );
+	if( ! req )
+	{
+		ssl_error("Failed to allocate request");
+	}
+
+	X509_REQ_set_version( req.get(), 0 );
+	ssl_setname( X509_REQ_get_subject_name( req.get() ), cn, company );
+
+	if( ! X509_REQ_set_pubkey( req.get(), key.get() ) )
+	{
+		ssl_error("Failed to set public key");
+	}
+
+	if( san.size() > 0 )
+	{
+		// Some values, i.e. dirName, dereference the context
+		X509V3_CTX ctx;
+		X509V3_set_ctx( &ctx, nullptr, nullptr, req.get(), nullptr, 0 );
+
+		X509_EXTENSIONPtr ext = ssl_extension( &ctx, NID_subject_alt_name, ssl_sanlist( san ) );
+
+		// Stack only borrows the extension
+		STACK_OF(X509_EXTENSION)* exts = sk_X509_EXTENSION_new_null();
+		int r = exts && sk_X509_EXTENSION_push( exts, ext.get() ) &&
+				X509_REQ_add_extensions( req.get(), exts );
+		sk_X509_EXTENSION_free( exts );
+
+		if( ! r )
+		{
+			ssl_error("Failed to add extensions");
+		}
+	}
+
+	if( X509_REQ_sign( req.get(), key.get(), md ) <= 0 )
+	{
+		ssl_error("Failed to sign request");
+	}
+
+	ssl_export( req.get(), PEM_write_bio_X509_REQ, i2d_X509_REQ, pem, der );
+}
+
+void SelfSigned(const string &keypem, const string &cn, const string &company, const string &digest, unsigned int days, const vector<string> &san, string &pem, vector<unsigned char> &der)
+{
+	EVP_PKEYPtr key = ssl_loadkey( keypem );
+	const EVP_MD* md = ssl_digest( digest );
+
+	X509Ptr cert( X509_new() );
+	if( ! cert )
+	{
+		ssl_error("Failed to allocate certificate");
+	}
+
+	X509_set_version( cert.get(), 2 );
+
+	// Random, positive, serial
+	unsigned char serial[16];
+	if( RAND_bytes( serial, sizeof( serial ) ) != 1 )
+	{
+		ssl_error("Failed to generate serial");
+	}
+	serial[0] &= 0x7f;
+
+	BIGNUMPtr bn( BN_bin2bn( serial, sizeof( serial ), nullptr ) );
+	if( ! bn || ! BN_to_ASN1_INTEGER( bn.get(), X509_get_serialNumber( cert.get() ) ) )
+	{
+		ssl_error("Failed to set serial");
+	}
+
+	X509_gmtime_adj( X509_getm_notBefore( cert.get() ), 0 );
+	X509_gmtime_adj( X509_getm_notAfter( cert.get() ), (long) days * 24 * 60 * 60 );
+
+	ssl_setname( X509_get_subject_name( cert.get() ), cn, company );
+	if( ! X509_set_issuer_name( cert.get(), X509_get_subject_name( cert.get() ) ) )
+	{
+		ssl_error("Failed to set issuer");
+	}
+
+	if( ! X509_set_pubkey( cert.get(), key.get() ) )
+	{
+		ssl_error("Failed to set public key");
+	}
+
+	// Same extensions as openssl req -x509 with default config
+	X509V3_CTX ctx;
+	X509V3_set_ctx( &ctx, cert.get(), cert.get(), nullptr, nullptr, 0 );
+
+	vector<pair<int, string>> exts = {
+		{ NID_subject_key_identifier, "hash" },
+		{ NID_authority_key_identifier, "keyid:always" },
+		{ NID_basic_constraints, "critical,CA:TRUE" },
+	};
+
+	if( san.size() > 0 )
+	{
+		exts.push_back( { NID_subject_alt_name, ssl_sanlist( san ) } );
+	}
+
+	for( const auto& ext: exts )
+	{
+		X509_EXTENSIONPtr e = ssl_extension( &ctx, ext.first, ext.second );
+		if( ! X509_add_ext( cert.get(), e.get(), -1 ) )
+		{
+			ssl_error("Failed to add extension");
+		}
+	}
+
+	if( X509_sign( cert.get(), key.get(), md ) <= 0 )
+	{
+		ssl_error("Failed to sign certificate");
+	}
+
+	ssl_export( cert.get(), PEM_write_bio_X509, i2d_X509, pem, der );
+}
+
+}
+}
@@ -0,0 +1,34 @@
+#ifndef X509BUILDER_H
+#define X509BUILDER_H
+
+#include <string>
+#include <vector>
+
+namespace OPI {
+namespace X509Builder {
+
+/*
+ * Certificate requests and self signed certificates using libcrypto,
+ * used by the CryptoHelper certificate functions.
+ *
+ * Kept apart from CryptoHelper since the libcrypto headers declares
+ * names, i.e. RSA and SHA1, clashing with the Crypto++ ones.
+ *
+ * Key is a PEM encoded private key, digest an openssl digest name
+ * and san entries are as in openssl configuration, "DNS:name".
+ * Result is returned both PEM and DER encoded. Errors throws
+ * runtime_error.
+ */
+
+void CSR(const std::string& keypem, const std::string& cn, const std::string& company,
+		const std::string& digest, const std::vector<std::string>& san,
+		std::string& pem, std::vector<unsigned char>& der);
+
+void SelfSigned(const std::string& keypem, const std::string& cn, const std::string& company,
+		const std::string& digest, unsigned int days, const std::vector<std::string>& san,
+		std::string& pem, std::vector<unsigned char>& der);
+
+}
+}
+
+#endif // X509BUILDER_H
@@ -0,0 +1,80 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Minimal helpers for the benchmark applications.
+ *
+ * Results are collected as json to make them easy to archive and
+ * compare between releases and platforms.
+ */
+namespace Bench
+{
+
+typedef chrono::steady_clock Clock;
+
+class Timer
+{
+public:
+	Timer(): start( Clock::now() ) {}
+
+	/* Elapsed time in microseconds */
+	double Elapsed()
+	{
+		return chrono::duration<double, micro>( Clock::now() - this->start ).count();
+	}
+
+	void Reset()
+	{
+		this->start = Clock::now();
+	}
+private:
+	Clock::time_point start;
+};
+
+inline double Percentile(vector<double>& samples, double pct)
+{
+	if( samples.size() == 0 )
+	{
+		return 0;
+	}
+
+	size_t idx = min( samples.size() - 1, (size_t)( pct / 100.0 * samples.size() ) );
+	nth_element( samples.begin(), samples.begin() + idx, samples.end() );
+
+	return samples[idx];
+}
+
+/*
+ * Summarize a run, ops operations in total taking usecs microseconds.
+ * Samples holds latency in microseconds of individual operations.
+ */
+inline Json::Value Result(const string& name, size_t ops, double usecs, vector<double> samples = {})
+{
+	Json::Value ret(Json::objectValue);
+
+	ret["name"] = name;
+	ret["ops"] = (Json::UInt64) ops;
+	ret["usecs"] = usecs;
+	ret["ops_per_sec"] = usecs > 0 ? ops * 1000000.0 / usecs : 0;
+
+	if( samples.size() > 0 )
+	{
+		ret["p50_us"] = Percentile( samples, 50 );
+		ret["p99_us"] = Percentile( samples, 99 );
+	}
+
+	return ret;
+}
+
+}
+
+#endif /* BENCH_H_ */
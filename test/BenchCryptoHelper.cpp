@@ -0,0 +1,654 @@
+/*
+ * CryptoHelper benchmark
+ *
+ * Measures wrapper construction, secure allocation, RSA key loading,
+ * at each validation level, and signing and verification throughput
+ * for 2048, 3072 and 4096 bit keys. ECDSA P-256 is included for
+ * comparison.
+ * AES CBC and GCM throughput is measured from 64 bytes up to 16 MiB,
+ * buffer handling overhead of Base64 and AES decoding on 4 MiB. The
+ * Base64 codec is compared to the Crypto++ filters on large and key
+ * sized input. PEM parsing, PBKDF2 derivation and file digests are
+ * covered as well.
+ *
+ * Results are printed as json together with a description of the
+ * platform, to be archived per release and compared between boards.
+ */
+
+#include "Bench.h"
+
+#include "CryptoHelper.h"
+#include "Base64.h"
+
+#include <libutils/Exceptions.h>
+#include <libutils/FileUtils.h>
+#include <libutils/Logger.h>
+
+#include <crypto++/base64.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include <sys/utsname.h>
+#include <unistd.h>
+
+using namespace OPI;
+using namespace OPI::CryptoHelper;
+
+static const string message = "A challenge of roughly the size used when authenticating with the backend";
+
+static Json::Value BenchKeyLoad(const vector<byte>& der, RSAWrapper::Validation v, const string& name, size_t count)
+{
+	vector<double> samples;
+	samples.reserve( count );
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		RSAWrapper rsa( v );
+		rsa.LoadPrivKeyFromDER( der );
+		samples.push_back( t.Elapsed() );
+	}
+
+	return Bench::Result( name, count, total.Elapsed(), samples );
+}
+
+static Json::Value BenchConstruct(size_t count)
+{
+	vector<double> samples;
+	samples.reserve( count );
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		RSAWrapper rsa;
+		samples.push_back( t.Elapsed() );
+	}
+
+	return Bench::Result( "construct", count, total.Elapsed(), samples );
+}
+
+/* Allocation of key sized secrets, arena against the Crypto++ allocator */
+template<class Alloc>
+static Json::Value BenchSecureAlloc(const string& name, size_t count)
+{
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i++ )
+	{
+		vector<byte, Alloc> key( 32 + i % 64, 1 );
+		vector<byte, Alloc> derived( key.begin(), key.end() );
+	}
+
+	return Bench::Result( name, count, total.Elapsed() );
+}
+
+static Json::Value BenchSign(RSAWrapper& rsa, size_t count)
+{
+	vector<double> samples;
+	samples.reserve( count );
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		rsa.SignMessage( message );
+		samples.push_back( t.Elapsed() );
+	}
+
+	return Bench::Result( "sign", count, total.Elapsed(), samples );
+}
+
+/* Reference, signer constructed per message */
+static Json::Value BenchSignUncached(const vector<byte>& der, size_t count)
+{
+	ByteQueue q;
+	q.Put( &der[0], der.size() );
+
+	RSA::PrivateKey key;
+	key.BERDecodePrivateKey( q, false, q.MaxRetrievable() );
+
+	AutoSeededRandomPool rng;
+	vector<double> samples;
+	samples.reserve( count );
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		RSASS<PKCS1v15, SHA1>::Signer signer( key );
+		SecByteBlock signature( signer.MaxSignatureLength() );
+		signer.SignMessage( rng, (const byte*) message.c_str(), message.length(), signature );
+		samples.push_back( t.Elapsed() );
+	}
+
+	return Bench::Result( "sign_uncached", count, total.Elapsed(), samples );
+}
+
+static Json::Value BenchVerify(RSAWrapper& rsa, size_t count)
+{
+	vector<byte> signature = rsa.SignMessage( message );
+	vector<double> samples;
+	samples.reserve( count );
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		if( ! rsa.VerifyMessage( message, signature ) )
+		{
+			cerr << "Verification failed" << endl;
+		}
+		samples.push_back( t.Elapsed() );
+	}
+
+	return Bench::Result( "verify", count, total.Elapsed(), samples );
+}
+
+/* Key loading, signing and verification, names suffixed with key size */
+static Json::Value BenchRSA(unsigned int bits, size_t count, size_t loads)
+{
+	Json::Value ret(Json::arrayValue);
+
+	RSAWrapper rsa;
+	rsa.GenerateKeys( bits );
+	vector<byte> der = rsa.GetPrivKeyAsDER();
+
+	ret.append( BenchKeyLoad( der, RSAWrapper::ValidateNone, "keyload_none", loads ) );
+	ret.append( BenchKeyLoad( der, RSAWrapper::ValidateCheap, "keyload_cheap", loads ) );
+	ret.append( BenchKeyLoad( der, RSAWrapper::ValidateFull, "keyload_full", loads ) );
+	ret.append( BenchSign( rsa, count ) );
+	ret.append( BenchSignUncached( der, count ) );
+	ret.append( BenchVerify( rsa, count ) );
+
+	for( auto& result: ret )
+	{
+		result["name"] = result["name"].asString() + "_" + to_string( bits );
+		result["keybits"] = bits;
+	}
+
+	return ret;
+}
+
+static Json::Value BenchECDSA(size_t count)
+{
+	Json::Value ret(Json::arrayValue);
+	vector<double> samples;
+	samples.reserve( count );
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		ECDSAKey key;
+		key.GenerateKeys();
+		samples.push_back( t.Elapsed() );
+	}
+	ret.append( Bench::Result( "ecdsa_keygen", count, total.Elapsed(), samples ) );
+
+	ECDSAKey key;
+	key.GenerateKeys();
+	vector<byte> signature;
+
+	samples.clear();
+	total.Reset();
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		signature = key.SignMessage( message );
+		samples.push_back( t.Elapsed() );
+	}
+	ret.append( Bench::Result( "ecdsa_sign", count, total.Elapsed(), samples ) );
+
+	samples.clear();
+	total.Reset();
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		if( ! key.VerifyMessage( message, signature ) )
+		{
+			cerr << "Verification failed" << endl;
+		}
+		samples.push_back( t.Elapsed() );
+	}
+	ret.append( Bench::Result( "ecdsa_verify", count, total.Elapsed(), samples ) );
+
+	return ret;
+}
+
+static Json::Value Throughput(const string& name, size_t rounds, size_t bytes, double usecs)
+{
+	Json::Value ret = Bench::Result( name, rounds, usecs );
+	ret["bytes"] = (Json::UInt64) bytes;
+	ret["mb_per_sec"] = usecs > 0 ? rounds * bytes / usecs : 0;
+
+	return ret;
+}
+
+/* I.e. 64b, 4k, 16m */
+static string SizeLabel(size_t size)
+{
+	if( size >= 1024 * 1024 )
+	{
+		return to_string( size / ( 1024 * 1024 ) ) + "m";
+	}
+	if( size >= 1024 )
+	{
+		return to_string( size / 1024 ) + "k";
+	}
+	return to_string( size ) + "b";
+}
+
+static Json::Value BenchAES(size_t size, size_t rounds)
+{
+	Json::Value ret(Json::arrayValue);
+	const string suffix = "_" + SizeLabel( size );
+	string plain( size, 'x' );
+	string enc;
+
+	AESWrapper cbc( SecVector<byte>( 32, 1 ) );
+	Bench::Timer t;
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		enc = cbc.Encrypt( plain );
+	}
+	ret.append( Throughput( "cbc_encrypt" + suffix, rounds, plain.size(), t.Elapsed() ) );
+
+	t.Reset();
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		cbc.Decrypt( enc );
+	}
+	ret.append( Throughput( "cbc_decrypt" + suffix, rounds, plain.size(), t.Elapsed() ) );
+
+	AESGCMWrapper gcm( SecVector<byte>( AESGCMWrapper::KeySize, 1 ) );
+	t.Reset();
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		enc = gcm.Encrypt( plain );
+	}
+	ret.append( Throughput( "gcm_encrypt" + suffix, rounds, plain.size(), t.Elapsed() ) );
+
+	t.Reset();
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		gcm.Decrypt( enc );
+	}
+	ret.append( Throughput( "gcm_decrypt" + suffix, rounds, plain.size(), t.Elapsed() ) );
+
+	return ret;
+}
+
+/*
+ * Decoding into caller buffers compared to the former route through
+ * an intermediate string that is then copied into the result.
+ */
+static Json::Value BenchBuffers(size_t rounds)
+{
+	Json::Value ret(Json::arrayValue);
+	string plain( 4 * 1024 * 1024, 'x' );
+	string b64 = Base64Encode( plain );
+	vector<byte> out;
+
+	Bench::Timer t;
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		string tmp = Base64DecodeToString( b64 );
+		out.resize( tmp.size() );
+		std::copy( tmp.begin(), tmp.end(), out.begin() );
+	}
+	ret.append( Throughput( "base64_decode_copy", rounds, b64.size(), t.Elapsed() ) );
+
+	vector<byte> buf( Base64MaxDecodedSize( b64.size() ) );
+	t.Reset();
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		Base64Decode( b64.data(), b64.size(), buf.data(), buf.size() );
+	}
+	ret.append( Throughput( "base64_decode_direct", rounds, b64.size(), t.Elapsed() ) );
+
+	AESWrapper aes( SecVector<byte>( 32, 1 ) );
+	vector<byte> enc;
+	aes.Encrypt( vector<byte>( plain.begin(), plain.end() ), enc );
+
+	t.Reset();
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		string tmp = aes.Decrypt( enc );
+		out.resize( tmp.size() );
+		std::copy( tmp.begin(), tmp.end(), out.begin() );
+	}
+	ret.append( Throughput( "cbc_decrypt_copy", rounds, enc.size(), t.Elapsed() ) );
+
+	buf.resize( enc.size() );
+	t.Reset();
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		aes.Decrypt( enc.data(), enc.size(), buf.data(), buf.size() );
+	}
+	ret.append( Throughput( "cbc_decrypt_direct", rounds, enc.size(), t.Elapsed() ) );
+
+	return ret;
+}
+
+/* Codec compared to the Crypto++ filter chains it replaced */
+static Json::Value BenchBase64(size_t rounds)
+{
+	Json::Value ret(Json::arrayValue);
+	string plain( 4 * 1024 * 1024, 'x' );
+	string b64;
+
+	Bench::Timer t;
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		b64.clear();
+		StringSource( plain, true, new Base64Encoder( new StringSink( b64 ), false ) );
+	}
+	ret.append( Throughput( "base64_encode_cryptopp", rounds, plain.size(), t.Elapsed() ) );
+
+	t.Reset();
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		b64 = Base64Encode( plain );
+	}
+	ret.append( Throughput( "base64_encode", rounds, plain.size(), t.Elapsed() ) );
+
+	string dec;
+	t.Reset();
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		dec.clear();
+		StringSource( b64, true, new Base64Decoder( new StringSink( dec ) ) );
+	}
+	ret.append( Throughput( "base64_decode_cryptopp", rounds, b64.size(), t.Elapsed() ) );
+
+	t.Reset();
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		dec = Base64DecodeToString( b64 );
+	}
+	ret.append( Throughput( "base64_decode", rounds, b64.size(), t.Elapsed() ) );
+
+	// Typical key sized input, dominated by per call overhead
+	vector<byte> key( 400, 1 );
+	size_t count = rounds * 10000;
+	t.Reset();
+	for( size_t i = 0; i < count; i++ )
+	{
+		b64.clear();
+		StringSource( key.data(), key.size(), true, new Base64Encoder( new StringSink( b64 ), false ) );
+	}
+	ret.append( Throughput( "base64_encode_small_cryptopp", count, key.size(), t.Elapsed() ) );
+
+	t.Reset();
+	for( size_t i = 0; i < count; i++ )
+	{
+		b64 = Base64Encode( key );
+	}
+	ret.append( Throughput( "base64_encode_small", count, key.size(), t.Elapsed() ) );
+
+	return ret;
+}
+
+/* Encode followed by decode, as when storing and reading back keys */
+static Json::Value BenchBase64RoundTrip(size_t size, size_t rounds)
+{
+	string plain( size, 'x' );
+	string dec;
+
+	Bench::Timer t;
+	for( size_t i = 0; i < rounds; i++ )
+	{
+		dec = Base64DecodeToString( Base64Encode( plain ) );
+	}
+	Json::Value ret = Throughput( "base64_roundtrip_" + SizeLabel( size ), rounds, size, t.Elapsed() );
+
+	if( dec != plain )
+	{
+		cerr << "Base64 round trip mismatch" << endl;
+	}
+
+	return ret;
+}
+
+/* Private key, certificate and public key in one file */
+static Json::Value BenchPEM(size_t count)
+{
+	Json::Value ret(Json::arrayValue);
+
+	RSAWrapper rsa;
+	rsa.GenerateKeys( 2048 );
+	const string pubpem = rsa.PubKeyAsPEM();
+	const string bundle = rsa.PrivKeyAsPEM()
+			+ CreateSelfSignedCert( rsa.PrivKeyAsPEM(), "localhost", "OpenProducts", "sha256" ).pem
+			+ pubpem;
+
+	Bench::Timer t;
+	for( size_t i = 0; i < count; i++ )
+	{
+		PEMParse( bundle );
+	}
+	ret.append( Throughput( "pem_parse", count, bundle.size(), t.Elapsed() ) );
+
+	string label;
+	vector<byte> der;
+	t.Reset();
+	for( size_t i = 0; i < count; i++ )
+	{
+		size_t pos = 0;
+		while( PEMNext( bundle, pos, label, der ) )
+		{
+		}
+	}
+	ret.append( Throughput( "pem_next", count, bundle.size(), t.Elapsed() ) );
+
+	t.Reset();
+	for( size_t i = 0; i < count; i++ )
+	{
+		RSAWrapper pub;
+		pub.LoadPubKeyFromPEM( pubpem );
+	}
+	ret.append( Bench::Result( "pem_loadpub", count, t.Elapsed() ) );
+
+	return ret;
+}
+
+/* Single, concurrent and cached derivations at the default iterations */
+static Json::Value BenchPBKDF2(size_t count)
+{
+	Json::Value ret(Json::arrayValue);
+	const SecString passwd = "A passphrase of typical length";
+	vector<double> samples;
+	samples.reserve( count );
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		PBKDF2( passwd, 32 );
+		samples.push_back( t.Elapsed() );
+	}
+	ret.append( Bench::Result( "pbkdf2_derive", count, total.Elapsed(), samples ) );
+
+	vector<PBKDF2Request> requests( max( 1u, thread::hardware_concurrency() ) * count,
+		PBKDF2Request{ passwd, 32, defaultsalt, 5000 } );
+	total.Reset();
+	PBKDF2( requests );
+	ret.append( Bench::Result( "pbkdf2_batch", requests.size(), total.Elapsed() ) );
+
+	PBKDF2Cache cache;
+	cache.Derive( passwd, 32 );
+	size_t hits = count * 1000;
+	total.Reset();
+	for( size_t i = 0; i < hits; i++ )
+	{
+		cache.Derive( passwd, 32 );
+	}
+	ret.append( Bench::Result( "pbkdf2_cached", hits, total.Elapsed() ) );
+
+	return ret;
+}
+
+/* Plain and tree digests of a 64 MiB file, mostly from page cache */
+static Json::Value BenchDigest(size_t rounds)
+{
+	Json::Value ret(Json::arrayValue);
+	const size_t size = 64 * 1024 * 1024;
+	char tmpl[] = "/tmp/cryptobench_digestXXXXXX";
+
+	int fd = mkstemp( tmpl );
+	if( fd < 0 )
+	{
+		throw Utils::ErrnoException("Failed to create digest file");
+	}
+	close( fd );
+
+	const string path( tmpl );
+	Utils::File::Write( path, string( size, 'x' ), 0600 );
+
+	struct {
+		DigestType type;
+		const char* name;
+	} types[] = {
+		{ DigestSHA256, "sha256" },
+		{ DigestSHA512, "sha512" },
+	};
+
+	for( const auto& type: types )
+	{
+		Bench::Timer t;
+		for( size_t i = 0; i < rounds; i++ )
+		{
+			DigestFile( path, type.type );
+		}
+		ret.append( Throughput( string("digest_") + type.name, rounds, size, t.Elapsed() ) );
+
+		t.Reset();
+		for( size_t i = 0; i < rounds; i++ )
+		{
+			TreeDigestFile( path, type.type );
+		}
+		ret.append( Throughput( string("treedigest_") + type.name, rounds, size, t.Elapsed() ) );
+	}
+
+	unlink( path.c_str() );
+
+	return ret;
+}
+
+static Json::Value Platform()
+{
+	Json::Value ret(Json::objectValue);
+	struct utsname u;
+
+	if( uname( &u ) == 0 )
+	{
+		ret["machine"] = u.machine;
+		ret["sysname"] = u.sysname;
+		ret["release"] = u.release;
+	}
+	ret["cpus"] = thread::hardware_concurrency();
+	ret["cryptopp"] = CRYPTOPP_VERSION;
+#ifdef LIBOPI_VERSION
+	ret["libopi"] = LIBOPI_VERSION;
+#endif
+	ret["compiler"] = __VERSION__;
+
+	return ret;
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = 200;
+	size_t loads = 10;
+	vector<unsigned int> keysizes = { 2048, 3072, 4096 };
+	int opt;
+
+	while( ( opt = getopt( argc, argv, "n:k:b:" ) ) != -1 )
+	{
+		switch( opt )
+		{
+		case 'n':
+			count = std::stoul( optarg );
+			break;
+		case 'k':
+			loads = std::stoul( optarg );
+			break;
+		case 'b':
+			keysizes = { (unsigned int) std::stoul( optarg ) };
+			break;
+		default:
+			cerr << "Usage: " << argv[0] << " [-n sign count] [-k key loads] [-b only key bits]" << endl;
+			return 1;
+		}
+	}
+
+	Utils::logg.SetLevel(Utils::Logger::Error);
+
+	Json::Value res(Json::objectValue);
+	res["benchmark"] = "cryptohelper";
+	res["platform"] = Platform();
+	res["results"].append( BenchConstruct( count ) );
+	res["results"].append( BenchSecureAlloc<SecureAllocator<byte>>( "alloc_arena", 100000 ) );
+	res["results"].append( BenchSecureAlloc<AllocatorWithCleanup<byte>>( "alloc_cleanup", 100000 ) );
+
+	for( unsigned int bits: keysizes )
+	{
+		res["keybits"].append( bits );
+		for( const auto& result: BenchRSA( bits, count, loads ) )
+		{
+			res["results"].append( result );
+		}
+	}
+
+	for( const auto& result: BenchECDSA( count ) )
+	{
+		res["results"].append( result );
+	}
+
+	// Roughly 16 MiB processed per size, small sizes show per call overhead
+	res["hw_aes"] = AESGCMWrapper::HardwareAccelerated();
+	for( size_t size: { 64, 4096, 1024 * 1024, 16 * 1024 * 1024 } )
+	{
+		size_t rounds = min( (size_t) 100000, max( (size_t) 8, 16 * 1024 * 1024 / size ) );
+		for( const auto& result: BenchAES( size, rounds ) )
+		{
+			res["results"].append( result );
+		}
+	}
+
+	for( const auto& result: BenchBuffers( 8 ) )
+	{
+		res["results"].append( result );
+	}
+
+	res["base64"] = OPI::Base64::Implementation();
+	for( const auto& result: BenchBase64( 8 ) )
+	{
+		res["results"].append( result );
+	}
+	res["results"].append( BenchBase64RoundTrip( 400, 80000 ) );
+	res["results"].append( BenchBase64RoundTrip( 4 * 1024 * 1024, 8 ) );
+
+	for( const auto& result: BenchPEM( count * 10 ) )
+	{
+		res["results"].append( result );
+	}
+
+	for( const auto& result: BenchPBKDF2( loads ) )
+	{
+		res["results"].append( result );
+	}
+
+	res["hw_sha"] = DigestHardwareAccelerated();
+	for( const auto& result: BenchDigest( 4 ) )
+	{
+		res["results"].append( result );
+	}
+
+	cout << res.toStyledString();
+
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * KDF benchmark
+ *
+ * Reports PBKDF2 derivations per second at the iteration count used
+ * by default, raw iteration throughput and the iteration counts that
+ * give the target unlock latency on this machine. When built against
+ * libcryptsetup 2 the argon2 parameter sets used for LUKS2 are
+ * calibrated as well.
+ */
+
+#include "Bench.h"
+
+#include "CryptoHelper.h"
+#include "Luks.h"
+
+#include <libutils/Logger.h>
+
+#include <iostream>
+
+#include <unistd.h>
+
+using namespace OPI;
+using namespace OPI::CryptoHelper;
+
+static const SecString passwd = "A passphrase of typical length";
+
+/* Derivations as done by PBKDF2(), i.e. SHA512 */
+static Json::Value BenchDerive(size_t count, unsigned int iter)
+{
+	vector<double> samples;
+	samples.reserve( count );
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		PBKDF2( passwd, 32, defaultsalt, iter );
+		samples.push_back( t.Elapsed() );
+	}
+
+	Json::Value ret = Bench::Result( "pbkdf2_derive", count, total.Elapsed(), samples );
+	ret["iterations"] = iter;
+
+	return ret;
+}
+
+static Json::Value BenchPBKDF2(PBKDF2Hash hash, const string& name, unsigned int iter, unsigned int target_ms)
+{
+	uint64_t ips = PBKDF2IterationsPerSec( hash, 200 );
+
+	Json::Value ret(Json::objectValue);
+	ret["name"] = name;
+	ret["iterations_per_sec"] = (Json::UInt64) ips;
+	ret["iterations"] = iter;
+	// Per output block, i.e. 20, 32 or 64 bytes
+	ret["derivations_per_sec"] = iter > 0 ? (double) ips / iter : 0;
+	ret["target_ms"] = target_ms;
+	ret["calibrated_iterations"] = PBKDF2Calibrate( target_ms, 32, hash, 200 );
+
+	return ret;
+}
+
+#ifdef CRYPT_LUKS2
+struct Argon2Set {
+	const char* name;
+	const char* type;
+	uint32_t max_memory_kb;
+	uint32_t parallel_threads;
+};
+
+/* Libcryptsetup defaults and the reduced set used on low memory boards */
+static const vector<Argon2Set> argon2sets = {
+	{ "argon2id_default", CRYPT_KDF_ARGON2ID, 1024*1024, 4 },
+	{ "argon2id_lowmem", CRYPT_KDF_ARGON2ID, 64*1024, 2 },
+	{ "argon2i_lowmem", CRYPT_KDF_ARGON2I, 64*1024, 2 },
+};
+
+static Json::Value BenchArgon2(const Argon2Set& set, unsigned int target_ms)
+{
+	struct crypt_pbkdf_type pbkdf = {};
+
+	pbkdf.type = set.type;
+	pbkdf.time_ms = target_ms;
+	pbkdf.max_memory_kb = set.max_memory_kb;
+	pbkdf.parallel_threads = set.parallel_threads;
+
+	Bench::Timer t;
+	Luks::BenchmarkPBKDF( pbkdf );
+	double usecs = t.Elapsed();
+
+	Json::Value ret(Json::objectValue);
+	ret["name"] = set.name;
+	ret["benchmark_usecs"] = usecs;
+	ret["target_ms"] = target_ms;
+	ret["iterations"] = pbkdf.iterations;
+	ret["memory_kb"] = pbkdf.max_memory_kb;
+	ret["threads"] = pbkdf.parallel_threads;
+
+	return ret;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+	size_t count = 10;
+	unsigned int iter = 5000;
+	unsigned int target_ms = 250;
+	int opt;
+
+	while( ( opt = getopt( argc, argv, "n:i:t:" ) ) != -1 )
+	{
+		switch( opt )
+		{
+		case 'n':
+			count = std::stoul( optarg );
+			break;
+		case 'i':
+			iter = std::stoul( optarg );
+			break;
+		case 't':
+			target_ms = std::stoul( optarg );
+			break;
+		default:
+			cerr << "Usage: " << argv[0] << " [-n derivations] [-i iterations] [-t target ms]" << endl;
+			return 1;
+		}
+	}
+
+	Utils::logg.SetLevel(Utils::Logger::Error);
+
+	Json::Value res(Json::objectValue);
+	res["benchmark"] = "kdf";
+
+	res["results"].append( BenchPBKDF2( PBKDF2SHA1, "pbkdf2_sha1", iter, target_ms ) );
+	res["results"].append( BenchPBKDF2( PBKDF2SHA256, "pbkdf2_sha256", iter, target_ms ) );
+	res["results"].append( BenchPBKDF2( PBKDF2SHA512, "pbkdf2_sha512", iter, target_ms ) );
+	res["results"].append( BenchDerive( count, iter ) );
+
+#ifdef CRYPT_LUKS2
+	for( const auto& set: argon2sets )
+	{
+		res["results"].append( BenchArgon2( set, target_ms ) );
+	}
+#endif
+
+	cout << res.toStyledString();
+
+	return 0;
+}
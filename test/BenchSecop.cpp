@@ -0,0 +1,239 @@
+/*
+ * Secop client round trip benchmark
+ *
+ * Runs against an in process stand in unless a socket path of a
+ * running secop is given with -s.
+ */
+
+#include "Bench.h"
+#include "SecopStandIn.h"
+
+#include "AsyncSecop.h"
+#include "Secop.h"
+
+#include <libutils/Logger.h>
+
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <mutex>
+
+#include <unistd.h>
+
+#define BENCHSOCKET	"benchsecop.sock"
+#define BATCHSIZE	32
+#define THREADS		4
+#define INFLIGHT	64
+
+using namespace OPI;
+
+static Json::Value hasacl()
+{
+	Json::Value cmd(Json::objectValue);
+
+	cmd["cmd"]			= "hasacl";
+	cmd["username"]		= "bench";
+	cmd["servicename"]	= "bench";
+	cmd["acl"]			= "read";
+
+	return cmd;
+}
+
+static Json::Value BenchSingle(const string& path, size_t count, Secop::Encoding enc)
+{
+	Secop s( path );
+	s.SockAuth();
+
+	if( ! s.SetEncoding( enc ) )
+	{
+		return Json::nullValue;
+	}
+
+	vector<double> samples;
+	samples.reserve( count );
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i++ )
+	{
+		Bench::Timer t;
+		s.HasACL("bench", "bench", "read");
+		samples.push_back( t.Elapsed() );
+	}
+
+	Json::Value cmd = hasacl();
+	cmd["tid"] = 0;
+	cmd["version"] = enc == Secop::CborEncoding ? 2.0 : 1.0;
+
+	Json::Value ret = Bench::Result( enc == Secop::CborEncoding ? "single_cbor" : "single", count, total.Elapsed(), samples );
+	ret["request_bytes"] = (Json::UInt64)( enc == Secop::CborEncoding ?
+										  JsonHelper::ToCBORFrame( cmd ).size() :
+										  Json::FastWriter().write( cmd ).size() );
+
+	return ret;
+}
+
+static Json::Value BenchPipelined(const string& path, size_t count, Secop::Encoding enc)
+{
+	Secop s( path );
+	s.SockAuth();
+
+	if( ! s.SetEncoding( enc ) )
+	{
+		return Json::nullValue;
+	}
+
+	vector<double> samples;
+	Secop::Batch b( s );
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i += BATCHSIZE )
+	{
+		b.Clear();
+		for( size_t j = i; j < count && j < i + BATCHSIZE; j++ )
+		{
+			b.Add( hasacl() );
+		}
+
+		Bench::Timer t;
+		b.Execute();
+		samples.push_back( t.Elapsed() );
+	}
+
+	Json::Value ret = Bench::Result( enc == Secop::CborEncoding ? "pipelined_cbor" : "pipelined", count, total.Elapsed(), samples );
+	ret["batchsize"] = BATCHSIZE;
+
+	return ret;
+}
+
+static Json::Value BenchConcurrent(const string& path, size_t count)
+{
+	SecopPool pool( path, THREADS );
+	vector<double> samples;
+	mutex lock;
+
+	vector<thread> workers;
+	Bench::Timer total;
+	for( int i = 0; i < THREADS; i++ )
+	{
+		workers.push_back( thread( [&]()
+		{
+			vector<double> local;
+			for( size_t j = 0; j < count / THREADS; j++ )
+			{
+				Bench::Timer t;
+				pool.Get()->HasACL("bench", "bench", "read");
+				local.push_back( t.Elapsed() );
+			}
+
+			lock_guard<mutex> l(lock);
+			samples.insert( samples.end(), local.begin(), local.end() );
+		}));
+	}
+
+	for( auto& worker: workers )
+	{
+		worker.join();
+	}
+
+	Json::Value ret = Bench::Result( "concurrent", ( count / THREADS ) * THREADS, total.Elapsed(), samples );
+	ret["threads"] = THREADS;
+
+	return ret;
+}
+
+static Json::Value BenchAsync(const string& path, size_t count)
+{
+	AsyncSecop as( path );
+	as.SockAuth().get();
+
+	vector<double> samples;
+	mutex lock;
+
+	Bench::Timer total;
+	for( size_t i = 0; i < count; i += INFLIGHT )
+	{
+		list<future<Json::Value>> replies;
+		for( size_t j = i; j < count && j < i + INFLIGHT; j++ )
+		{
+			auto start = Bench::Clock::now();
+			auto p = make_shared<promise<Json::Value>>();
+			replies.push_back( p->get_future() );
+
+			as.Call( hasacl(), [&samples, &lock, start, p](const Json::Value& rep)
+			{
+				{
+					lock_guard<mutex> l(lock);
+					samples.push_back( chrono::duration<double, micro>( Bench::Clock::now() - start ).count() );
+				}
+				p->set_value( rep );
+			});
+		}
+
+		for( auto& reply: replies )
+		{
+			reply.get();
+		}
+	}
+
+	Json::Value ret = Bench::Result( "async", count, total.Elapsed(), samples );
+	ret["inflight"] = INFLIGHT;
+
+	return ret;
+}
+
+int main(int argc, char** argv)
+{
+	string path;
+	size_t count = 10000;
+	int opt;
+
+	while( ( opt = getopt( argc, argv, "n:s:" ) ) != -1 )
+	{
+		switch( opt )
+		{
+		case 'n':
+			count = std::stoul( optarg );
+			break;
+		case 's':
+			path = optarg;
+			break;
+		default:
+			cerr << "Usage: " << argv[0] << " [-n count] [-s secop socket]" << endl;
+			return 1;
+		}
+	}
+
+	Utils::logg.SetLevel(Utils::Logger::Error);
+
+	unique_ptr<SecopStandIn> standin;
+	if( path == "" )
+	{
+		path = BENCHSOCKET;
+		standin.reset( new SecopStandIn( path ) );
+
+		Secop s( path );
+		s.CreateUser("bench", "bench");
+		s.AddService("bench", "bench");
+		s.AddACL("bench", "bench", "read");
+	}
+
+	Json::Value res(Json::objectValue);
+	res["benchmark"] = "secop";
+	res["results"].append( BenchSingle( path, count, Secop::JsonEncoding ) );
+	res["results"].append( BenchPipelined( path, count, Secop::JsonEncoding ) );
+	res["results"].append( BenchConcurrent( path, count ) );
+	res["results"].append( BenchAsync( path, count ) );
+
+	// Binary encoding, skipped if not supported by server
+	for( auto& result: { BenchSingle( path, count, Secop::CborEncoding ), BenchPipelined( path, count, Secop::CborEncoding ) } )
+	{
+		if( ! result.isNull() )
+		{
+			res["results"].append( result );
+		}
+	}
+
+	cout << res.toStyledString();
+
+	return 0;
+}
@@ -0,0 +1,521 @@
+#include "SecopStandIn.h"
+
+#include "JsonHelper.h"
+
+#include <libutils/Exceptions.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <cstring>
+
+using namespace OPI;
+
+static Json::Value ok()
+{
+	Json::Value ret(Json::objectValue);
+
+	ret["status"]["value"] = 0;
+	ret["status"]["desc"] = "OK";
+
+	return ret;
+}
+
+static Json::Value fail(const string& desc)
+{
+	Json::Value ret(Json::objectValue);
+
+	ret["status"]["value"] = 1;
+	ret["status"]["desc"] = desc;
+
+	return ret;
+}
+
+static Json::Value tolist(const set<string>& items)
+{
+	Json::Value ret(Json::arrayValue);
+
+	for( const auto& item: items )
+	{
+		ret.append( item );
+	}
+
+	return ret;
+}
+
+static Json::Value toidentifiers(const list<map<string,string>>& ids)
+{
+	Json::Value ret(Json::arrayValue);
+
+	for( const auto& id: ids )
+	{
+		ret.append( JsonHelper::ToJsonObject( id ) );
+	}
+
+	return ret;
+}
+
+/* Remove identifiers matching all values in id */
+static void removeidentifiers(list<map<string,string>>& ids, const map<string,string>& id)
+{
+	ids.remove_if( [&id](const map<string,string>& cand)
+	{
+		for( const auto& val: id )
+		{
+			auto it = cand.find( val.first );
+			if( it == cand.end() || it->second != val.second )
+			{
+				return false;
+			}
+		}
+		return true;
+	});
+}
+
+SecopStandIn::SecopStandIn(const string &path): path(path), listenfd(-1), running(false), requests(0)
+{
+	this->stopfd[0] = this->stopfd[1] = -1;
+	this->Start();
+}
+
+void SecopStandIn::Start()
+{
+	if( this->running )
+	{
+		return;
+	}
+
+	struct sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	strncpy( addr.sun_path, this->path.c_str(), sizeof(addr.sun_path) - 1 );
+
+	unlink( this->path.c_str() );
+
+	if( ( this->listenfd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) < 0 )
+	{
+		throw Utils::ErrnoException("Failed to create stand in socket");
+	}
+
+	if( bind( this->listenfd, (struct sockaddr*) &addr, sizeof(addr) ) < 0 ||
+			listen( this->listenfd, 64 ) < 0 || pipe( this->stopfd ) < 0 )
+	{
+		close( this->listenfd );
+		throw Utils::ErrnoException("Failed to setup stand in socket");
+	}
+
+	this->running = true;
+	this->acceptor = thread( &SecopStandIn::Accept, this );
+}
+
+void SecopStandIn::Stop()
+{
+	if( ! this->running )
+	{
+		return;
+	}
+
+	if( write( this->stopfd[1], "x", 1 ) < 0 )
+	{
+		throw Utils::ErrnoException("Failed to stop stand in");
+	}
+	this->acceptor.join();
+
+	vector<thread> workers;
+	{
+		lock_guard<mutex> lock(this->lock);
+		for( int fd: this->clients )
+		{
+			shutdown( fd, SHUT_RDWR );
+		}
+		workers.swap( this->workers );
+	}
+
+	for( auto& worker: workers )
+	{
+		worker.join();
+	}
+
+	close( this->listenfd );
+	close( this->stopfd[0] );
+	close( this->stopfd[1] );
+	unlink( this->path.c_str() );
+
+	this->running = false;
+}
+
+size_t SecopStandIn::Requests()
+{
+	lock_guard<mutex> lock(this->lock);
+
+	return this->requests;
+}
+
+SecopStandIn::~SecopStandIn()
+{
+	this->Stop();
+}
+
+void SecopStandIn::Accept()
+{
+	struct pollfd fds[2] = {
+		{ this->listenfd, POLLIN, 0 },
+		{ this->stopfd[0], POLLIN, 0 }
+	};
+
+	while( poll( fds, 2, -1 ) >= 0 || errno == EINTR )
+	{
+		if( fds[1].revents )
+		{
+			break;
+		}
+
+		if( fds[0].revents & POLLIN )
+		{
+			int fd = accept4( this->listenfd, nullptr, nullptr, SOCK_CLOEXEC );
+			if( fd >= 0 )
+			{
+				lock_guard<mutex> lock(this->lock);
+				this->clients.push_back( fd );
+				this->workers.push_back( thread( &SecopStandIn::Serve, this, fd ) );
+			}
+		}
+	}
+}
+
+void SecopStandIn::Serve(int fd)
+{
+	JsonHelper::StreamFramer framer;
+	Json::FastWriter writer;
+	Json::Reader reader;
+
+	while( true )
+	{
+		char* buf = framer.Reserve( 4096 );
+		ssize_t rd = read( fd, buf, framer.Space() );
+		if( rd <= 0 )
+		{
+			break;
+		}
+		framer.Commit( rd );
+
+		// Collect all replies to pipelined requests in one write
+		string out;
+		const char *start, *end;
+		while( framer.Next( start, end ) )
+		{
+			bool cbor = framer.GetFraming() == JsonHelper::StreamFramer::LengthFraming;
+
+			Json::Value cmd, rep;
+			bool parsed = cbor ?
+						JsonHelper::FromCBOR( start, end, cmd ) :
+						reader.parse( start, end, cmd );
+			framer.Consume();
+
+			rep = parsed ? this->Handle( cmd ) : fail("Failed to parse request");
+
+			// Encoding negotiation, protocol version 2
+			string encoding;
+			if( parsed && cmd["cmd"].asString() == "status" &&
+					cmd["version"].asDouble() >= 2.0 && cmd.isMember("encoding") )
+			{
+				encoding = cmd["encoding"].asString();
+				if( encoding == "cbor" || encoding == "json" )
+				{
+					rep["encoding"] = encoding;
+					rep["version"] = 2.0;
+				}
+			}
+
+			string r = cbor ? JsonHelper::ToCBORFrame( rep ) : writer.write( rep );
+			if( ! cbor && encoding != "" )
+			{
+				// No trailing whitespace, next message might be binary
+				r.pop_back();
+			}
+			out += r;
+
+			if( encoding == "cbor" )
+			{
+				framer.SetFraming( JsonHelper::StreamFramer::LengthFraming );
+			}
+			else if( encoding == "json" )
+			{
+				framer.SetFraming( JsonHelper::StreamFramer::JsonFraming );
+			}
+		}
+
+		size_t written = 0;
+		while( written < out.size() )
+		{
+			ssize_t wr = send( fd, out.c_str() + written, out.size() - written, MSG_NOSIGNAL );
+			if( wr <= 0 )
+			{
+				break;
+			}
+			written += wr;
+		}
+
+		if( framer.Failed() )
+		{
+			break;
+		}
+	}
+
+	lock_guard<mutex> lock(this->lock);
+	for( auto it = this->clients.begin(); it != this->clients.end(); it++ )
+	{
+		if( *it == fd )
+		{
+			this->clients.erase( it );
+			break;
+		}
+	}
+	close( fd );
+}
+
+Json::Value SecopStandIn::Handle(const Json::Value &cmd)
+{
+	lock_guard<mutex> lock(this->lock);
+	this->requests++;
+
+	string c = cmd["cmd"].asString();
+	string user = cmd["username"].asString();
+	string service = cmd["servicename"].asString();
+	string group = cmd["group"].asString();
+	string appid = cmd["appid"].asString();
+
+	Json::Value ret = ok();
+
+	bool needuser = c == "removeuser" || c == "updateuserpassword" || c == "getusergroups" ||
+			c == "addattribute" || c == "getattributes" || c == "getattribute" ||
+			c == "getservices" || c == "addservice" || c == "removeservice" ||
+			c == "getacl" || c == "addacl" || c == "removeacl" || c == "hasacl" ||
+			c == "addidentifier" || c == "removeidentifier" || c == "getidentifiers";
+	bool needservice = c == "removeservice" || c == "getacl" || c == "addacl" ||
+			c == "removeacl" || c == "hasacl" || c == "addidentifier" ||
+			c == "removeidentifier" || c == "getidentifiers";
+	bool needgroup = c == "groupaddmember" || c == "groupgetmembers" ||
+			c == "groupremove" || c == "groupremovemember";
+	bool needapp = c == "removeappid" || c == "addappidentifier" || c == "getappidentifiers" ||
+			c == "appremoveidentifier" || c == "addappacl" || c == "getappacl" ||
+			c == "removeappacl" || c == "hasappacl";
+
+	if( needuser && this->users.find( user ) == this->users.end() )
+	{
+		ret = fail("Unknown user");
+	}
+	else if( needservice && this->users[user].services.find( service ) == this->users[user].services.end() )
+	{
+		ret = fail("Unknown service");
+	}
+	else if( needgroup && this->groups.find( group ) == this->groups.end() )
+	{
+		ret = fail("Unknown group");
+	}
+	else if( needapp && this->apps.find( appid ) == this->apps.end() )
+	{
+		ret = fail("Unknown appid");
+	}
+	else if( c == "init" || c == "auth" )
+	{
+		// Always accept
+	}
+	else if( c == "status" )
+	{
+		ret["server"]["state"] = 0x04;
+	}
+	else if( c == "createuser" )
+	{
+		if( this->users.find( user ) != this->users.end() )
+		{
+			ret = fail("User exists");
+		}
+		else
+		{
+			this->users[user].password = cmd["password"].asString();
+		}
+	}
+	else if( c == "updateuserpassword" )
+	{
+		this->users[user].password = cmd["password"].asString();
+	}
+	else if( c == "removeuser" )
+	{
+		this->users.erase( user );
+		for( auto& g: this->groups )
+		{
+			g.second.erase( user );
+		}
+	}
+	else if( c == "getusers" )
+	{
+		ret["users"] = Json::arrayValue;
+		for( const auto& u: this->users )
+		{
+			ret["users"].append( u.first );
+		}
+	}
+	else if( c == "getusergroups" )
+	{
+		ret["groups"] = Json::arrayValue;
+		for( const auto& g: this->groups )
+		{
+			if( g.second.find( user ) != g.second.end() )
+			{
+				ret["groups"].append( g.first );
+			}
+		}
+	}
+	else if( c == "addattribute" )
+	{
+		this->users[user].attributes[ cmd["attribute"].asString() ] = cmd["value"].asString();
+	}
+	else if( c == "getattributes" )
+	{
+		ret["attributes"] = Json::arrayValue;
+		for( const auto& a: this->users[user].attributes )
+		{
+			ret["attributes"].append( a.first );
+		}
+	}
+	else if( c == "getattribute" )
+	{
+		auto& attrs = this->users[user].attributes;
+		if( attrs.find( cmd["attribute"].asString() ) == attrs.end() )
+		{
+			ret = fail("Unknown attribute");
+		}
+		else
+		{
+			ret["attribute"] = attrs[ cmd["attribute"].asString() ];
+		}
+	}
+	else if( c == "getservices" )
+	{
+		ret["services"] = Json::arrayValue;
+		for( const auto& s: this->users[user].services )
+		{
+			ret["services"].append( s.first );
+		}
+	}
+	else if( c == "addservice" )
+	{
+		this->users[user].services[service];
+	}
+	else if( c == "removeservice" )
+	{
+		this->users[user].services.erase( service );
+	}
+	else if( c == "getacl" )
+	{
+		ret["acl"] = tolist( this->users[user].services[service].acl );
+	}
+	else if( c == "addacl" )
+	{
+		this->users[user].services[service].acl.insert( cmd["acl"].asString() );
+	}
+	else if( c == "removeacl" )
+	{
+		this->users[user].services[service].acl.erase( cmd["acl"].asString() );
+	}
+	else if( c == "hasacl" )
+	{
+		auto& acl = this->users[user].services[service].acl;
+		ret["hasacl"] = acl.find( cmd["acl"].asString() ) != acl.end();
+	}
+	else if( c == "addidentifier" )
+	{
+		this->users[user].services[service].identifiers.push_back( JsonHelper::FromJsonObject( cmd["identifier"] ) );
+	}
+	else if( c == "removeidentifier" )
+	{
+		removeidentifiers( this->users[user].services[service].identifiers, JsonHelper::FromJsonObject( cmd["identifier"] ) );
+	}
+	else if( c == "getidentifiers" )
+	{
+		ret["identifiers"] = toidentifiers( this->users[user].services[service].identifiers );
+	}
+	else if( c == "groupadd" )
+	{
+		this->groups[group];
+	}
+	else if( c == "groupaddmember" )
+	{
+		this->groups[group].insert( cmd["member"].asString() );
+	}
+	else if( c == "groupgetmembers" )
+	{
+		ret["members"] = tolist( this->groups[group] );
+	}
+	else if( c == "groupsget" )
+	{
+		ret["groups"] = Json::arrayValue;
+		for( const auto& g: this->groups )
+		{
+			ret["groups"].append( g.first );
+		}
+	}
+	else if( c == "groupremove" )
+	{
+		this->groups.erase( group );
+	}
+	else if( c == "groupremovemember" )
+	{
+		this->groups[group].erase( cmd["member"].asString() );
+	}
+	else if( c == "createappid" )
+	{
+		this->apps[appid];
+	}
+	else if( c == "getappids" )
+	{
+		ret["appids"] = Json::arrayValue;
+		for( const auto& a: this->apps )
+		{
+			ret["appids"].append( a.first );
+		}
+	}
+	else if( c == "removeappid" )
+	{
+		this->apps.erase( appid );
+	}
+	else if( c == "addappidentifier" )
+	{
+		this->apps[appid].identifiers.push_back( JsonHelper::FromJsonObject( cmd["identifier"] ) );
+	}
+	else if( c == "getappidentifiers" )
+	{
+		ret["identifiers"] = toidentifiers( this->apps[appid].identifiers );
+	}
+	else if( c == "appremoveidentifier" )
+	{
+		removeidentifiers( this->apps[appid].identifiers, JsonHelper::FromJsonObject( cmd["identifier"] ) );
+	}
+	else if( c == "addappacl" )
+	{
+		this->apps[appid].acl.insert( cmd["acl"].asString() );
+	}
+	else if( c == "getappacl" )
+	{
+		ret["acl"] = tolist( this->apps[appid].acl );
+	}
+	else if( c == "removeappacl" )
+	{
+		this->apps[appid].acl.erase( cmd["acl"].asString() );
+	}
+	else if( c == "hasappacl" )
+	{
+		auto& acl = this->apps[appid].acl;
+		ret["hasacl"] = acl.find( cmd["acl"].asString() ) != acl.end();
+	}
+	else
+	{
+		ret = fail("Unknown command");
+	}
+
+	ret["tid"] = cmd["tid"];
+
+	return ret;
+}
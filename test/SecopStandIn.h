@@ -0,0 +1,71 @@
+#ifndef SECOPSTANDIN_H_
+#define SECOPSTANDIN_H_
+
+#include <json/json.h>
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <list>
+#include <map>
+#include <set>
+
+using namespace std;
+
+/*
+ * In process stand in for the secop daemon.
+ *
+ * Speaks the secop json protocol over a unix socket and keeps users,
+ * groups and appids in memory. Intended for tests and benchmarks.
+ * Supports negotiation of cbor encoding using protocol version 2.
+ */
+class SecopStandIn
+{
+public:
+	SecopStandIn(const string& path);
+
+	void Start();
+	/* Stop listening and drop all client connections */
+	void Stop();
+
+	size_t Requests();
+
+	/* Process one command, public to allow direct use */
+	Json::Value Handle(const Json::Value& cmd);
+
+	virtual ~SecopStandIn();
+private:
+	struct Service
+	{
+		set<string> acl;
+		list<map<string,string>> identifiers;
+	};
+
+	struct User
+	{
+		string password;
+		map<string,string> attributes;
+		map<string,Service> services;
+	};
+
+	void Accept();
+	void Serve(int fd);
+
+	string path;
+	int listenfd;
+	int stopfd[2];
+	bool running;
+	size_t requests;
+
+	mutex lock;
+	thread acceptor;
+	vector<int> clients;
+	vector<thread> workers;
+
+	map<string,User> users;
+	map<string,set<string>> groups;
+	map<string,Service> apps;
+};
+
+#endif /* SECOPSTANDIN_H_ */
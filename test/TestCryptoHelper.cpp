@@ -1,7 +1,16 @@
 #include "TestCryptoHelper.h"
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <thread>
 #include "CryptoHelper.h"
+
+#include <crypto++/base64.h>
 #include <libutils/FileUtils.h>
 #include <libutils/Process.h>
 
@@ -47,3 +56,562 @@ void TestCryptoHelper::TestSelfSigned()
 	unlink("testpub.pem");
 	unlink("testcert.pem");
 }
+
+void TestCryptoHelper::TestCertificates()
+{
+	CryptoHelper::RSAWrapper rsa;
+	rsa.GenerateKeys(1024);
+
+	CryptoHelper::X509Object cert = CryptoHelper::CreateSelfSignedCert( rsa.PrivKeyAsPEM(), "localhost", "OpenProducts",
+			"sha256", 30, { "DNS:localhost", "IP:127.0.0.1" } );
+
+	// PEM and DER forms carries the same certificate
+	vector<CryptoHelper::PEMObject> objs = CryptoHelper::PEMParse( cert.pem );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1, objs.size() );
+	CPPUNIT_ASSERT_EQUAL( string("CERTIFICATE"), objs[0].label );
+	CPPUNIT_ASSERT( objs[0].der == cert.der );
+
+	File::Write("testcert.pem", cert.pem, 0600);
+
+	bool ret;
+	string out;
+	tie(ret, out) = Process::Exec("openssl x509 -in testcert.pem -noout -text");
+	CPPUNIT_ASSERT(ret);
+	CPPUNIT_ASSERT( out.find("DNS:localhost") != string::npos );
+	CPPUNIT_ASSERT( out.find("sha256WithRSAEncryption") != string::npos );
+
+	// Works with EC keys as well
+	CryptoHelper::ECDSAKey ec;
+	ec.GenerateKeys();
+
+	CryptoHelper::X509Object csr = CryptoHelper::CreateCSR( ec.PrivKeyAsPEM(), "host.example", "OpenProducts" );
+	objs = CryptoHelper::PEMParse( csr.pem );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1, objs.size() );
+	CPPUNIT_ASSERT_EQUAL( string("CERTIFICATE REQUEST"), objs[0].label );
+
+	File::Write("testcsr.pem", csr.pem, 0600);
+	tie(ret, ignore) = Process::Exec("openssl req -in testcsr.pem -verify -noout");
+	CPPUNIT_ASSERT(ret);
+
+	CPPUNIT_ASSERT_THROW( CryptoHelper::CreateCSR( "garbage", "a", "b" ), runtime_error );
+	CPPUNIT_ASSERT_THROW( CryptoHelper::CreateCSR( ec.PrivKeyAsPEM(), "a", "b", "nosuchdigest" ), runtime_error );
+	CPPUNIT_ASSERT_THROW( CryptoHelper::CreateCSR( ec.PrivKeyAsPEM(), "a", "b", "sha256", { "dirName:nosection" } ), runtime_error );
+	CPPUNIT_ASSERT( ! CryptoHelper::MakeCSR( "nosuchkey.pem", "testcsr.pem", "a", "b" ) );
+
+	unlink("testcert.pem");
+	unlink("testcsr.pem");
+}
+
+void TestCryptoHelper::TestSignVerify()
+{
+	CryptoHelper::RSAWrapper a, b;
+	a.GenerateKeys(1024);
+	b.GenerateKeys(1024);
+
+	vector<byte> sig = a.SignMessage("Hello World");
+	CPPUNIT_ASSERT( a.VerifyMessage("Hello World", sig) );
+	CPPUNIT_ASSERT( ! a.VerifyMessage("Hello world", sig) );
+	CPPUNIT_ASSERT( a.VerifyMessage("Hello World", string( sig.begin(), sig.end() ) ) );
+
+	// Cached signer and verifier must follow newly loaded keys
+	for( auto v: { CryptoHelper::RSAWrapper::ValidateNone,
+			CryptoHelper::RSAWrapper::ValidateCheap,
+			CryptoHelper::RSAWrapper::ValidateFull } )
+	{
+		a.SetValidation( v );
+		CPPUNIT_ASSERT_EQUAL( v, a.GetValidation() );
+
+		a.LoadPubKeyFromDER( b.GetPubKeyAsDER() );
+		CPPUNIT_ASSERT( ! a.VerifyMessage("Hello World", sig) );
+		CPPUNIT_ASSERT( a.VerifyMessage("Hello World", b.SignMessage("Hello World") ) );
+
+		a.LoadPrivKeyFromDER( b.GetPrivKeyAsDER() );
+		CPPUNIT_ASSERT( b.VerifyMessage("Hello World", a.SignMessage("Hello World") ) );
+	}
+}
+
+void TestCryptoHelper::TestKeyPool()
+{
+	CryptoHelper::RSAKeyPool pool;
+
+	pool.Reserve( 1024, 2 );
+	for( int i = 0; i < 600 && pool.Available( 1024 ) < 2; i++ )
+	{
+		usleep( 50000 );
+	}
+	CPPUNIT_ASSERT_EQUAL( (size_t) 2, pool.Available( 1024 ) );
+
+	CryptoHelper::RSAWrapperPtr a = pool.Get( 1024 );
+	CryptoHelper::RSAWrapperPtr b = pool.Get( 1024 );
+	CPPUNIT_ASSERT( a->GetPrivKeyAsDER() != b->GetPrivKeyAsDER() );
+
+	// Private and public part of pooled keys match
+	vector<byte> sig = a->SignMessage( "Hello World" );
+	CPPUNIT_ASSERT( a->VerifyMessage( "Hello World", sig ) );
+	CPPUNIT_ASSERT( ! b->VerifyMessage( "Hello World", sig ) );
+
+	// Not reserved, generated inline
+	CryptoHelper::RSAWrapperPtr c = pool.Get( 1536 );
+	CPPUNIT_ASSERT( c->VerifyMessage( "Hello", c->SignMessage( "Hello" ) ) );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 0, pool.Available( 1536 ) );
+
+	pool.Stop();
+	CPPUNIT_ASSERT_EQUAL( (size_t) 0, pool.Available( 1024 ) );
+}
+
+void TestCryptoHelper::TestRNG()
+{
+	RandomNumberGenerator* mine = &CryptoHelper::RNG();
+	CPPUNIT_ASSERT( mine == &CryptoHelper::RNG() );
+
+	vector<byte> a(32), b(32);
+	CryptoHelper::RNG().GenerateBlock( a.data(), a.size() );
+
+	RandomNumberGenerator* other = nullptr;
+	thread t( [&]()
+	{
+		other = &CryptoHelper::RNG();
+		CryptoHelper::RNG().GenerateBlock( b.data(), b.size() );
+	});
+	t.join();
+
+	CPPUNIT_ASSERT( other != mine );
+	CPPUNIT_ASSERT( a != b );
+
+	// Forked child does not repeat output of parent
+	int fds[2];
+	CPPUNIT_ASSERT( pipe( fds ) == 0 );
+
+	pid_t pid = fork();
+	if( pid == 0 )
+	{
+		CryptoHelper::RNG().GenerateBlock( b.data(), b.size() );
+		_exit( write( fds[1], b.data(), b.size() ) == (ssize_t) b.size() ? 0 : 1 );
+	}
+	CPPUNIT_ASSERT( pid > 0 );
+
+	CryptoHelper::RNG().GenerateBlock( a.data(), a.size() );
+	CPPUNIT_ASSERT_EQUAL( (ssize_t) b.size(), read( fds[0], b.data(), b.size() ) );
+	waitpid( pid, nullptr, 0 );
+	close( fds[0] );
+	close( fds[1] );
+
+	CPPUNIT_ASSERT( a != b );
+
+	// Shared wrapper signs and verifies concurrently
+	CryptoHelper::RSAWrapper rsa;
+	rsa.GenerateKeys( 1024 );
+
+	atomic<int> failed( 0 );
+	vector<thread> threads;
+	for( int i = 0; i < 4; i++ )
+	{
+		threads.push_back( thread( [&rsa, &failed, i]()
+		{
+			for( int j = 0; j < 20; j++ )
+			{
+				string msg = "Message " + to_string( i ) + ":" + to_string( j );
+				if( ! rsa.VerifyMessage( msg, rsa.SignMessage( msg ) ) )
+				{
+					failed++;
+				}
+			}
+		}));
+	}
+
+	for( auto& th: threads )
+	{
+		th.join();
+	}
+
+	CPPUNIT_ASSERT_EQUAL( 0, failed.load() );
+}
+
+void TestCryptoHelper::TestECDSA()
+{
+	CryptoHelper::ECDSAKey a;
+	a.GenerateKeys();
+
+	vector<byte> sig = a.SignMessage("Hello World");
+	CPPUNIT_ASSERT_EQUAL( (size_t) 64, sig.size() );
+	CPPUNIT_ASSERT( a.VerifyMessage("Hello World", sig) );
+	CPPUNIT_ASSERT( ! a.VerifyMessage("Hello world", sig) );
+	CPPUNIT_ASSERT( ! a.VerifyMessage("Hello World", vector<byte>( sig.begin(), sig.end() - 1 ) ) );
+
+	// Round trip through PEM and DER
+	CryptoHelper::ECDSAKey b;
+	b.LoadPubKeyFromPEM( a.PubKeyAsPEM() );
+	b.LoadPrivKeyFromPEM( a.PrivKeyAsPEM() );
+	CPPUNIT_ASSERT( b.VerifyMessage("Hello World", string( sig.begin(), sig.end() ) ) );
+	CPPUNIT_ASSERT( a.VerifyMessage("Hello World", b.SignMessage("Hello World") ) );
+	CPPUNIT_ASSERT( a.GetPubKeyAsDER() == b.GetPubKeyAsDER() );
+
+	// Same interface as RSA keys
+	CryptoHelper::RSAWrapperPtr rsa( new CryptoHelper::RSAWrapper );
+	rsa->GenerateKeys(1024);
+
+	// PEM output unchanged from the Crypto++ encoder, wrapped at 72
+	vector<byte> der = rsa->GetPubKeyAsDER();
+	string expected;
+	StringSource( der.data(), der.size(), true, new Base64Encoder( new StringSink( expected ) ) );
+	CPPUNIT_ASSERT_EQUAL( "-----BEGIN PUBLIC KEY-----\n" + expected + "-----END PUBLIC KEY-----\n", rsa->PubKeyAsPEM() );
+
+	CryptoHelper::ECDSAKeyPtr ec( new CryptoHelper::ECDSAKey );
+	ec->GenerateKeys();
+
+	for( CryptoHelper::SigningKeyPtr key: { CryptoHelper::SigningKeyPtr( rsa ), CryptoHelper::SigningKeyPtr( ec ) } )
+	{
+		CPPUNIT_ASSERT( key->VerifyMessage("msg", key->SignMessage("msg") ) );
+	}
+
+	// Usable with openssl
+	File::Write("testecpriv.pem", a.PrivKeyAsPEM(), 0600);
+	bool ret;
+	tie(ret, ignore) = Process::Exec("openssl pkey -in testecpriv.pem -noout");
+	CPPUNIT_ASSERT(ret);
+	unlink("testecpriv.pem");
+}
+
+void TestCryptoHelper::TestAESStream()
+{
+	CryptoHelper::SecVector<byte> key( 32, 0x42 );
+	CryptoHelper::AESWrapper aes( key );
+
+	// Multiple chunks with a partial last chunk
+	string plain;
+	for( size_t i = 0; i < 3 * CryptoHelper::AESWrapper::ChunkSize + 17; i++ )
+	{
+		plain += (char)( i % 251 );
+	}
+
+	stringstream in( plain ), enc;
+	CPPUNIT_ASSERT_EQUAL( aes.Encrypt( plain ).size(), aes.Encrypt( in, enc ) );
+	CPPUNIT_ASSERT( aes.Encrypt( plain ) == enc.str() );
+
+	stringstream dec;
+	CPPUNIT_ASSERT_EQUAL( plain.size(), aes.Decrypt( enc, dec ) );
+	CPPUNIT_ASSERT( plain == dec.str() );
+
+	// File descriptors
+	File::Write("testaes.enc", aes.Encrypt( plain ), 0600);
+
+	int infd = open("testaes.enc", O_RDONLY);
+	int outfd = open("testaes.dec", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	CPPUNIT_ASSERT( infd >= 0 && outfd >= 0 );
+	CPPUNIT_ASSERT_EQUAL( plain.size(), aes.Decrypt( infd, outfd ) );
+	close( infd );
+	close( outfd );
+
+	CPPUNIT_ASSERT( plain == File::GetContentAsString( "testaes.dec", true ) );
+
+	// Empty input still produces a padding block
+	stringstream empty, emptyenc;
+	CPPUNIT_ASSERT_EQUAL( (size_t) 16, aes.Encrypt( empty, emptyenc ) );
+
+	unlink("testaes.enc");
+	unlink("testaes.dec");
+}
+
+void TestCryptoHelper::TestAESGCM()
+{
+	CryptoHelper::SecVector<byte> key( CryptoHelper::AESGCMWrapper::KeySize, 0x17 );
+	CryptoHelper::AESGCMWrapper gcm( key, 1000 );
+
+	for( size_t size: { 0, 1, 999, 1000, 1001, 20000 } )
+	{
+		string plain( size, 'a' );
+		string enc = gcm.Encrypt( plain );
+
+		CPPUNIT_ASSERT( enc != gcm.Encrypt( plain ) );
+		CPPUNIT_ASSERT( plain == gcm.Decrypt( enc ) );
+	}
+
+	string plain( 5000, 'b' );
+	string enc = gcm.Encrypt( plain );
+
+	// Modified data
+	string bad = enc;
+	bad[ bad.size() / 2 ] ^= 1;
+	CPPUNIT_ASSERT_THROW( gcm.Decrypt( bad ), runtime_error );
+
+	// No plain text of any chunk left in caller buffer
+	vector<byte> buf( plain.size(), 0xff );
+	CPPUNIT_ASSERT_THROW( gcm.Decrypt( (const byte*) bad.data(), bad.size(), buf.data(), buf.size() ), runtime_error );
+	CPPUNIT_ASSERT( std::all_of( buf.begin(), buf.end(), [](byte b){ return b == 0; } ) );
+
+	// Dropped last chunk
+	CPPUNIT_ASSERT_THROW( gcm.Decrypt( enc.substr( 0, enc.size() - 1016 ) ), runtime_error );
+
+	// Wrong key
+	CryptoHelper::AESGCMWrapper other( CryptoHelper::SecVector<byte>( CryptoHelper::AESGCMWrapper::KeySize, 0x18 ) );
+	vector<byte> in( enc.begin(), enc.end() ), out;
+	CPPUNIT_ASSERT_THROW( other.Decrypt( in, out ), runtime_error );
+	CPPUNIT_ASSERT( out.empty() );
+
+	CPPUNIT_ASSERT_THROW( gcm.Decrypt( "short" ), runtime_error );
+}
+
+void TestCryptoHelper::TestBuffers()
+{
+	string plain = "The quick brown fox jumps over the lazy dog";
+
+	// Base64
+	vector<char> b64( CryptoHelper::Base64EncodedSize( plain.size() ) );
+	size_t len = CryptoHelper::Base64Encode( (const byte*) plain.data(), plain.size(), b64.data(), b64.size() );
+	CPPUNIT_ASSERT_EQUAL( CryptoHelper::Base64Encode( plain ), string( b64.data(), len ) );
+
+	vector<byte> dec( CryptoHelper::Base64MaxDecodedSize( len ) );
+	size_t declen = CryptoHelper::Base64Decode( b64.data(), len, dec.data(), dec.size() );
+	CPPUNIT_ASSERT_EQUAL( plain, string( dec.begin(), dec.begin() + declen ) );
+	CPPUNIT_ASSERT_EQUAL( plain, CryptoHelper::Base64DecodeToString( string( b64.data(), len ) ) );
+
+	CPPUNIT_ASSERT_THROW( CryptoHelper::Base64Decode( b64.data(), len, dec.data(), 2 ), runtime_error );
+
+	// AES
+	CryptoHelper::AESWrapper aes( CryptoHelper::SecVector<byte>( 32, 0x42 ) );
+	vector<byte> enc( CryptoHelper::AESWrapper::EncryptedSize( plain.size() ) );
+	len = aes.Encrypt( (const byte*) plain.data(), plain.size(), enc.data(), enc.size() );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 48, len );
+	CPPUNIT_ASSERT( aes.Encrypt( plain ) == string( enc.begin(), enc.begin() + len ) );
+
+	vector<byte> out( len );
+	CPPUNIT_ASSERT_EQUAL( plain.size(), aes.Decrypt( enc.data(), len, out.data(), out.size() ) );
+	CPPUNIT_ASSERT_EQUAL( plain, string( out.begin(), out.begin() + plain.size() ) );
+
+	CPPUNIT_ASSERT_THROW( aes.Encrypt( (const byte*) plain.data(), plain.size(), enc.data(), 16 ), runtime_error );
+
+	// AES-GCM
+	CryptoHelper::AESGCMWrapper gcm( CryptoHelper::SecVector<byte>( CryptoHelper::AESGCMWrapper::KeySize, 0x42 ) );
+	vector<byte> genc( gcm.EncryptedSize( plain.size() ) );
+	CPPUNIT_ASSERT_EQUAL( genc.size(), gcm.Encrypt( (const byte*) plain.data(), plain.size(), genc.data(), genc.size() ) );
+
+	vector<byte> gdec( gcm.DecryptedSize( genc.data(), genc.size() ) );
+	CPPUNIT_ASSERT_EQUAL( plain.size(), gcm.Decrypt( genc.data(), genc.size(), gdec.data(), gdec.size() ) );
+	CPPUNIT_ASSERT_EQUAL( plain, string( gdec.begin(), gdec.end() ) );
+}
+
+/* Must behave exactly as the Crypto++ filters it replaced */
+void TestCryptoHelper::TestBase64()
+{
+	AutoSeededRandomPool rng;
+
+	for( size_t size = 0; size < 2000; size += 1 + size / 8 )
+	{
+		vector<byte> data( size );
+		rng.GenerateBlock( data.data(), data.size() );
+
+		string expected;
+		StringSource( data.data(), data.size(), true, new Base64Encoder( new StringSink( expected ), false ) );
+
+		string encoded = CryptoHelper::Base64Encode( data );
+		CPPUNIT_ASSERT_EQUAL( expected, encoded );
+		CPPUNIT_ASSERT( data == CryptoHelper::Base64Decode( encoded ) );
+
+		// Line breaks, white space and garbage are skipped
+		string messy;
+		StringSource( data.data(), data.size(), true, new Base64Encoder( new StringSink( messy ), true, 64 ) );
+		for( size_t i = 0; i < messy.size(); i += 1 + rng.GenerateWord32( 0, 40 ) )
+		{
+			messy.insert( i, 1, " \r\t=*-\x80\xff"[ rng.GenerateWord32( 0, 7 ) ] );
+		}
+
+		string reference;
+		StringSource( messy, true, new Base64Decoder( new StringSink( reference ) ) );
+		CPPUNIT_ASSERT( reference == CryptoHelper::Base64DecodeToString( messy ) );
+	}
+}
+
+void TestCryptoHelper::TestPEM()
+{
+	CryptoHelper::RSAWrapper rsa;
+	rsa.GenerateKeys(1024);
+	CryptoHelper::ECDSAKey ec;
+	ec.GenerateKeys();
+
+	// Bundle with text around and between objects
+	string bundle = "Bag attributes\n" + rsa.PubKeyAsPEM() + "\n" + ec.PubKeyAsPEM() + "trailer\r\n" + ec.PrivKeyAsPEM();
+
+	vector<CryptoHelper::PEMObject> objs = CryptoHelper::PEMParse( bundle );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 3, objs.size() );
+	CPPUNIT_ASSERT_EQUAL( string("PUBLIC KEY"), objs[0].label );
+	CPPUNIT_ASSERT( rsa.GetPubKeyAsDER() == objs[0].der );
+	CPPUNIT_ASSERT( ec.GetPubKeyAsDER() == objs[1].der );
+	CPPUNIT_ASSERT_EQUAL( string("PRIVATE KEY"), objs[2].label );
+	CPPUNIT_ASSERT( ec.GetPrivKeyAsDER() == objs[2].der );
+
+	// Key loading still works with CRLF line endings
+	string pem = rsa.PrivKeyAsPEM();
+	for( size_t pos = pem.find('\n'); pos != string::npos; pos = pem.find('\n', pos + 2) )
+	{
+		pem.insert( pos, "\r" );
+	}
+	CryptoHelper::RSAWrapper loaded;
+	loaded.LoadPrivKeyFromPEM( pem );
+	CPPUNIT_ASSERT( rsa.GetPrivKeyAsDER() == loaded.GetPrivKeyAsDER() );
+
+	CPPUNIT_ASSERT( CryptoHelper::PEMParse( "no pem here" ).empty() );
+	CPPUNIT_ASSERT_THROW( CryptoHelper::PEMParse( "-----BEGIN A-----\nYWJj\n-----END B-----\n" ), runtime_error );
+	CPPUNIT_ASSERT_THROW( loaded.LoadPubKeyFromPEM( "garbage" ), runtime_error );
+}
+
+void TestCryptoHelper::TestPBKDF2()
+{
+	CryptoHelper::PBKDF2Cache cache( 4 );
+
+	CryptoHelper::SecVector<byte> key = CryptoHelper::PBKDF2( "secret", 32 );
+	CPPUNIT_ASSERT( key == cache.Derive( "secret", 32 ) );
+	CPPUNIT_ASSERT( key == cache.Derive( "secret", 32 ) );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1, cache.Size() );
+
+	// All parameters are part of the cache key
+	CPPUNIT_ASSERT( key != cache.Derive( "secret", 32, CryptoHelper::defaultsalt, 5001 ) );
+	CPPUNIT_ASSERT( key != cache.Derive( "Secret", 32 ) );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 16, cache.Derive( "secret", 16 ).size() );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 4, cache.Size() );
+
+	cache.Derive( "other", 32, { 1, 2, 3, 4 } );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 4, cache.Size() );
+
+	cache.SetMaxEntries( 2 );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 2, cache.Size() );
+
+	cache.Wipe();
+	CPPUNIT_ASSERT_EQUAL( (size_t) 0, cache.Size() );
+	CPPUNIT_ASSERT( key == cache.Derive( "secret", 32 ) );
+
+	// Batch gives same result as one by one
+	vector<CryptoHelper::PBKDF2Request> reqs;
+	for( int i = 0; i < 8; i++ )
+	{
+		reqs.push_back( { CryptoHelper::SecString( ( "pwd" + to_string(i) ).c_str() ), 32, { (byte) i }, 1000 } );
+	}
+
+	vector<CryptoHelper::SecVector<byte>> keys = CryptoHelper::PBKDF2( reqs );
+	CPPUNIT_ASSERT_EQUAL( reqs.size(), keys.size() );
+	for( size_t i = 0; i < reqs.size(); i++ )
+	{
+		CPPUNIT_ASSERT( keys[i] == CryptoHelper::PBKDF2( reqs[i].passwd, 32, reqs[i].salt, 1000 ) );
+	}
+}
+
+void TestCryptoHelper::TestSecureArena()
+{
+	CryptoHelper::SecureArena& arena = CryptoHelper::SecureArena::Instance();
+	CryptoHelper::SecureArena::Stats before = arena.GetStats();
+
+	{
+		CryptoHelper::SecString pwd( "A password long enough to not fit inline" );
+		CryptoHelper::SecVector<byte> key( 32, 0x55 );
+		CryptoHelper::SecVector<byte> large( 3 * CryptoHelper::SecureArena::MaxClassSize, 0xaa );
+
+		CryptoHelper::SecureArena::Stats st = arena.GetStats();
+		CPPUNIT_ASSERT_EQUAL( before.allocations + 3, st.allocations );
+		CPPUNIT_ASSERT_EQUAL( before.large + 1, st.large );
+		CPPUNIT_ASSERT_EQUAL( before.classes[32] + 1, st.classes[32] );
+		CPPUNIT_ASSERT( st.inuse >= before.inuse + 32 + 3 * CryptoHelper::SecureArena::MaxClassSize );
+		CPPUNIT_ASSERT( st.mapped >= st.inuse );
+		CPPUNIT_ASSERT( st.locked <= st.mapped );
+	}
+
+	CryptoHelper::SecureArena::Stats after = arena.GetStats();
+	CPPUNIT_ASSERT_EQUAL( before.allocations, after.allocations );
+	CPPUNIT_ASSERT_EQUAL( before.inuse, after.inuse );
+	CPPUNIT_ASSERT_EQUAL( before.large, after.large );
+	CPPUNIT_ASSERT( after.total >= before.total + 3 );
+
+	// Zeroized on release, but for the free list link
+	byte* p = (byte*) arena.Allocate( 64 );
+	memset( p, 0xff, 64 );
+	arena.Release( p, 64 );
+	for( size_t i = sizeof( void* ); i < 64; i++ )
+	{
+		CPPUNIT_ASSERT_EQUAL( (byte) 0, p[i] );
+	}
+
+	// Slots are reused
+	byte* q = (byte*) arena.Allocate( 64 );
+	CPPUNIT_ASSERT( p == q );
+	arena.Release( q, 64 );
+
+	// Size classes share slabs, one of each fits a single slab
+	before = arena.GetStats();
+	vector<pair<void*, size_t>> slots;
+	for( size_t s = CryptoHelper::SecureArena::MinClassSize; s <= CryptoHelper::SecureArena::MaxClassSize; s *= 2 )
+	{
+		slots.push_back( make_pair( arena.Allocate( s ), s ) );
+	}
+	CPPUNIT_ASSERT( arena.GetStats().mapped <= before.mapped + CryptoHelper::SecureArena::SlabSize );
+	for( auto& slot: slots )
+	{
+		arena.Release( slot.first, slot.second );
+	}
+}
+
+void TestCryptoHelper::TestKDFCalibrate()
+{
+	uint64_t sha1 = CryptoHelper::PBKDF2IterationsPerSec( CryptoHelper::PBKDF2SHA1, 20 );
+	uint64_t sha512 = CryptoHelper::PBKDF2IterationsPerSec( CryptoHelper::PBKDF2SHA512, 20 );
+
+	CPPUNIT_ASSERT( sha1 > 0 );
+	CPPUNIT_ASSERT( sha512 > 0 );
+
+	// Longer target, more iterations. Keys spanning two blocks half as many
+	unsigned int short_iter = CryptoHelper::PBKDF2Calibrate( 50, 32, CryptoHelper::PBKDF2SHA256, 20 );
+	unsigned int long_iter = CryptoHelper::PBKDF2Calibrate( 500, 32, CryptoHelper::PBKDF2SHA256, 20 );
+	unsigned int wide_iter = CryptoHelper::PBKDF2Calibrate( 500, 64, CryptoHelper::PBKDF2SHA256, 20 );
+
+	CPPUNIT_ASSERT( short_iter >= CryptoHelper::PBKDF2MinIterations );
+	CPPUNIT_ASSERT( long_iter > short_iter );
+	CPPUNIT_ASSERT( wide_iter < long_iter );
+
+	CPPUNIT_ASSERT_EQUAL( CryptoHelper::PBKDF2MinIterations,
+			CryptoHelper::PBKDF2Calibrate( 0, 32, CryptoHelper::PBKDF2SHA512, 20 ) );
+}
+
+void TestCryptoHelper::TestDigest()
+{
+	CPPUNIT_ASSERT_EQUAL( string("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"),
+			CryptoHelper::HexEncode( CryptoHelper::Digest( "abc" ) ) );
+	CPPUNIT_ASSERT_EQUAL( string("ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+								 "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f"),
+			CryptoHelper::HexEncode( CryptoHelper::Digest( "abc", CryptoHelper::DigestSHA512 ) ) );
+
+	string data;
+	for( int i = 0; i < 100000; i++ )
+	{
+		data += to_string( i );
+	}
+	File::Write( "testdigest.bin", data, 0600 );
+
+	CPPUNIT_ASSERT( CryptoHelper::Digest( data ) == CryptoHelper::DigestFile( "testdigest.bin" ) );
+
+	bool ret;
+	string out;
+	tie(ret, out) = Process::Exec("sha256sum testdigest.bin");
+	CPPUNIT_ASSERT( ret );
+	CPPUNIT_ASSERT_EQUAL( out.substr( 0, 64 ), CryptoHelper::HexEncode( CryptoHelper::DigestFile( "testdigest.bin" ) ) );
+
+	// Same tree digest read concurrently from file and sequentially from pipe
+	vector<byte> tree = CryptoHelper::TreeDigestFile( "testdigest.bin", CryptoHelper::DigestSHA256, 4096 );
+	CPPUNIT_ASSERT( tree != CryptoHelper::DigestFile( "testdigest.bin" ) );
+	CPPUNIT_ASSERT( tree != CryptoHelper::TreeDigestFile( "testdigest.bin", CryptoHelper::DigestSHA256, 8192 ) );
+
+	int fds[2];
+	CPPUNIT_ASSERT( pipe( fds ) == 0 );
+	pid_t pid = fork();
+	if( pid == 0 )
+	{
+		close( fds[0] );
+		_exit( write( fds[1], data.c_str(), data.size() ) == (ssize_t) data.size() ? 0 : 1 );
+	}
+	CPPUNIT_ASSERT( pid > 0 );
+	close( fds[1] );
+
+	CPPUNIT_ASSERT( tree == CryptoHelper::TreeDigestFd( fds[0], CryptoHelper::DigestSHA256, 4096 ) );
+	close( fds[0] );
+	waitpid( pid, nullptr, 0 );
+
+	CPPUNIT_ASSERT_THROW( CryptoHelper::DigestFile( "/nonexistent/file" ), std::exception );
+
+	unlink( "testdigest.bin" );
+}
@@ -7,11 +7,39 @@ class TestCryptoHelper: public CppUnit::TestFixture
 {
 	CPPUNIT_TEST_SUITE( TestCryptoHelper );
 	CPPUNIT_TEST( TestSelfSigned );
+	CPPUNIT_TEST( TestCertificates );
+	CPPUNIT_TEST( TestSignVerify );
+	CPPUNIT_TEST( TestKeyPool );
+	CPPUNIT_TEST( TestRNG );
+	CPPUNIT_TEST( TestECDSA );
+	CPPUNIT_TEST( TestAESStream );
+	CPPUNIT_TEST( TestAESGCM );
+	CPPUNIT_TEST( TestBuffers );
+	CPPUNIT_TEST( TestBase64 );
+	CPPUNIT_TEST( TestPEM );
+	CPPUNIT_TEST( TestPBKDF2 );
+	CPPUNIT_TEST( TestSecureArena );
+	CPPUNIT_TEST( TestKDFCalibrate );
+	CPPUNIT_TEST( TestDigest );
 	CPPUNIT_TEST_SUITE_END();
 public:
 	void setUp();
 	void tearDown();
 	void TestSelfSigned();
+	void TestCertificates();
+	void TestSignVerify();
+	void TestKeyPool();
+	void TestRNG();
+	void TestECDSA();
+	void TestAESStream();
+	void TestAESGCM();
+	void TestBuffers();
+	void TestBase64();
+	void TestPEM();
+	void TestPBKDF2();
+	void TestSecureArena();
+	void TestKDFCalibrate();
+	void TestDigest();
 };
 
 #endif /* TESTCRYPTOHELPER_H_ */
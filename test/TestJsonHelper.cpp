@@ -1,6 +1,7 @@
 #include "TestJsonHelper.h"
 
 #include <unistd.h>
+#include <cstring>
 #include "JsonHelper.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION ( TestJsonHelper );
@@ -114,3 +115,106 @@ void TestJsonHelper::TestConverters()
 	}
 
 }
+
+void TestJsonHelper::TestStreamFramer()
+{
+	const char *start, *end;
+
+	{ // Messages split over several writes
+		StreamFramer f(8);
+		string data = "{\"a\":\"}\\\"{\",\"b\":[1,2]}\n{\"c\":{}}\n";
+
+		CPPUNIT_ASSERT( ! f.Next(start, end) );
+
+		f.Append( data.c_str(), 10 );
+		CPPUNIT_ASSERT( ! f.Next(start, end) );
+
+		f.Append( data.c_str() + 10, data.size() - 10 );
+		CPPUNIT_ASSERT( f.Next(start, end) );
+		CPPUNIT_ASSERT_EQUAL( string("{\"a\":\"}\\\"{\",\"b\":[1,2]}"), string(start, end) );
+		f.Consume();
+
+		CPPUNIT_ASSERT( f.Next(start, end) );
+		CPPUNIT_ASSERT_EQUAL( string("{\"c\":{}}"), string(start, end) );
+		f.Consume();
+
+		CPPUNIT_ASSERT( ! f.Next(start, end) );
+	}
+
+	{ // Large message grows buffer
+		StreamFramer f(16);
+		string data = "{\"a\":\"" + string(100000, 'x') + "\"}";
+
+		for( size_t i = 0; i < data.size(); i += 1000 )
+		{
+			size_t len = std::min( (size_t)1000, data.size() - i );
+			memcpy( f.Reserve( len ), data.c_str() + i, len );
+			f.Commit( len );
+		}
+
+		CPPUNIT_ASSERT( f.Next(start, end) );
+		CPPUNIT_ASSERT_EQUAL( data.size(), (size_t)(end - start) );
+
+		Json::Value v;
+		Json::Reader r;
+		CPPUNIT_ASSERT( r.parse(start, end, v) );
+		CPPUNIT_ASSERT_EQUAL( (size_t)100000, v["a"].asString().size() );
+		f.Consume();
+		CPPUNIT_ASSERT_EQUAL( (size_t)0, f.Buffered() );
+	}
+}
+
+void TestJsonHelper::TestCBOR()
+{
+	Json::Value v(Json::objectValue);
+	v["null"] = Json::Value();
+	v["bool"] = true;
+	v["int"] = -1234567;
+	v["uint"] = (Json::UInt64) 0xffffffffffffffffULL;
+	v["real"] = 2.5;
+	v["string"] = "Hello world";
+	v["array"].append( 1 );
+	v["array"].append( "two" );
+	v["object"]["a"] = "b";
+
+	string enc = ToCBOR( v );
+
+	Json::Value dec;
+	CPPUNIT_ASSERT( FromCBOR( enc.data(), enc.data() + enc.size(), dec ) );
+	CPPUNIT_ASSERT( v == dec );
+
+	// Truncated data should fail
+	CPPUNIT_ASSERT( ! FromCBOR( enc.data(), enc.data() + enc.size() - 1, dec ) );
+
+	// Length framed messages
+	StreamFramer f;
+	f.SetFraming( StreamFramer::LengthFraming );
+
+	string frame = ToCBORFrame( v );
+	f.Append( frame.data(), 3 );
+
+	const char *start, *end;
+	CPPUNIT_ASSERT( ! f.Next( start, end ) );
+
+	f.Append( frame.data() + 3, frame.size() - 3 );
+	f.Append( frame.data(), frame.size() );
+
+	for( int i = 0; i < 2; i++ )
+	{
+		CPPUNIT_ASSERT( f.Next( start, end ) );
+		CPPUNIT_ASSERT( FromCBOR( start, end, dec ) );
+		CPPUNIT_ASSERT( v == dec );
+		f.Consume();
+	}
+	CPPUNIT_ASSERT( ! f.Next( start, end ) );
+	CPPUNIT_ASSERT( ! f.Failed() );
+
+	// Oversized length is a protocol error
+	f.Append( "\xff\xff\xff\xff", 4 );
+	CPPUNIT_ASSERT( ! f.Next( start, end ) );
+	CPPUNIT_ASSERT( f.Failed() );
+
+	f.Clear();
+	f.Append( frame.data(), frame.size() );
+	CPPUNIT_ASSERT( f.Next( start, end ) );
+}
@@ -9,6 +9,8 @@ class TestJsonHelper: public CppUnit::TestFixture
 	CPPUNIT_TEST( Test );
 	CPPUNIT_TEST( TestCallback );
 	CPPUNIT_TEST( TestConverters );
+	CPPUNIT_TEST( TestStreamFramer );
+	CPPUNIT_TEST( TestCBOR );
 	CPPUNIT_TEST_SUITE_END();
 public:
 	void setUp();
@@ -16,6 +18,8 @@ public:
 	void Test();
 	void TestCallback();
 	void TestConverters();
+	void TestStreamFramer();
+	void TestCBOR();
 };
 
 #endif /* TESTJSONHELPER_H_ */
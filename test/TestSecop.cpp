@@ -0,0 +1,363 @@
+#include "TestSecop.h"
+
+#include "SecopStandIn.h"
+#include "AsyncSecop.h"
+#include "Secop.h"
+
+#include <memory>
+
+CPPUNIT_TEST_SUITE_REGISTRATION ( TestSecop );
+
+#define TESTSOCKET "testsecop.sock"
+
+using namespace OPI;
+
+static unique_ptr<SecopStandIn> standin;
+
+void TestSecop::setUp()
+{
+	standin.reset( new SecopStandIn( TESTSOCKET ) );
+}
+
+void TestSecop::tearDown()
+{
+	standin.reset();
+}
+
+void TestSecop::Test()
+{
+	Secop s( TESTSOCKET );
+
+	CPPUNIT_ASSERT( s.SockAuth() );
+	CPPUNIT_ASSERT_EQUAL( Secop::Authenticated, s.Status() );
+
+	CPPUNIT_ASSERT( s.CreateUser("user", "secret") );
+	CPPUNIT_ASSERT( ! s.CreateUser("user", "secret") );
+	CPPUNIT_ASSERT( s.AddService("user", "service") );
+	CPPUNIT_ASSERT( s.AddACL("user", "service", "read") );
+
+	CPPUNIT_ASSERT( s.HasACL("user", "service", "read") );
+	CPPUNIT_ASSERT( ! s.HasACL("user", "service", "write") );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1, s.GetUsers().size() );
+
+	CPPUNIT_ASSERT_THROW( s.GetACL("nouser", "service"), runtime_error );
+}
+
+void TestSecop::TestBatch()
+{
+	Secop s( TESTSOCKET );
+	s.SockAuth();
+
+	s.CreateUser("user", "secret");
+
+	Secop::Batch b( s );
+	b.AddService("user", "service");
+	for( int i = 0; i < 100; i++ )
+	{
+		b.AddACL("user", "service", "acl" + to_string(i) );
+	}
+	size_t bad = b.AddACL("nouser", "service", "acl");
+
+	CPPUNIT_ASSERT_EQUAL( (size_t) 102, b.Size() );
+	CPPUNIT_ASSERT( ! b.Execute() );
+
+	for( size_t i = 0; i < bad; i++ )
+	{
+		CPPUNIT_ASSERT( b.Ok( i ) );
+	}
+	CPPUNIT_ASSERT( ! b.Ok( bad ) );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 100, s.GetACL("user", "service").size() );
+
+	// Connection still usable for single calls after batch
+	CPPUNIT_ASSERT( s.HasACL("user", "service", "acl99") );
+}
+
+void TestSecop::TestLargeReply()
+{
+	Secop s( TESTSOCKET );
+	s.SockAuth();
+
+	s.CreateUser("user", "secret");
+	s.AddService("user", "service");
+
+	Secop::Batch b( s );
+	for( int i = 0; i < 1000; i++ )
+	{
+		b.AddIdentifier("user", "service", { {"id", to_string(i) }, {"data", string(100, 'x') } } );
+	}
+	CPPUNIT_ASSERT( b.Execute() );
+
+	list<map<string,string>> ids = s.GetIdentifiers("user", "service");
+
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1000, ids.size() );
+	CPPUNIT_ASSERT_EQUAL( string("999"), ids.back()["id"] );
+}
+
+void TestSecop::TestEncoding()
+{
+	Secop s( TESTSOCKET );
+	s.SockAuth();
+
+	CPPUNIT_ASSERT_EQUAL( Secop::JsonEncoding, s.GetEncoding() );
+	CPPUNIT_ASSERT( s.SetEncoding( Secop::CborEncoding ) );
+	CPPUNIT_ASSERT_EQUAL( Secop::CborEncoding, s.GetEncoding() );
+
+	CPPUNIT_ASSERT( s.CreateUser("user", "secret") );
+	CPPUNIT_ASSERT( s.AddService("user", "service") );
+
+	Secop::Batch b( s );
+	for( int i = 0; i < 100; i++ )
+	{
+		b.AddIdentifier("user", "service", { {"id", to_string(i) }, {"data", string(200, 'x') } } );
+	}
+	CPPUNIT_ASSERT( b.Execute() );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 100, s.GetIdentifiers("user", "service").size() );
+
+	// Encoding is restored on reconnect
+	s.SetAutoReconnect( true );
+	standin->Stop();
+	standin->Start();
+	CPPUNIT_ASSERT( s.HasACL("user", "service", "none") == false );
+	CPPUNIT_ASSERT_EQUAL( Secop::CborEncoding, s.GetEncoding() );
+
+	CPPUNIT_ASSERT( s.SetEncoding( Secop::JsonEncoding ) );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1, s.GetUsers().size() );
+}
+
+void TestSecop::TestPool()
+{
+	SecopPool pool( TESTSOCKET );
+
+	{
+		SecopPtr s = pool.Get();
+		CPPUNIT_ASSERT( s->CreateUser("user", "secret") );
+		CPPUNIT_ASSERT_EQUAL( (size_t) 0, pool.Idle() );
+	}
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1, pool.Idle() );
+
+	// Secop restart, pooled connection should reconnect
+	standin->Stop();
+	standin->Start();
+
+	{
+		SecopPtr s = pool.Get();
+		CPPUNIT_ASSERT( s->CreateUser("user2", "secret") );
+	}
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1, pool.Idle() );
+
+	// User authenticated connections are not handed out again
+	{
+		SecopPtr s = pool.Get();
+		CPPUNIT_ASSERT( s->PlainAuth("user", "secret") );
+	}
+	CPPUNIT_ASSERT_EQUAL( (size_t) 0, pool.Idle() );
+
+	pool.Get();
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1, pool.Idle() );
+
+	pool.Clear();
+	CPPUNIT_ASSERT_EQUAL( (size_t) 0, pool.Idle() );
+
+	// Connections may outlive their pool
+	SecopPtr s;
+	{
+		SecopPool shortlived( TESTSOCKET );
+		s = shortlived.Get();
+	}
+	CPPUNIT_ASSERT_EQUAL( (size_t) 2, s->GetUsers().size() );
+	s.reset();
+}
+
+void TestSecop::TestCache()
+{
+	SecopPool pool( TESTSOCKET );
+	SecopCache cache( 30, pool );
+
+	{
+		SecopPtr s = pool.Get();
+		s->CreateUser("user", "secret");
+		s->AddService("user", "service");
+		s->AddGroup("group");
+	}
+
+	CPPUNIT_ASSERT( ! cache.HasACL("user", "service", "read") );
+
+	size_t reqs = standin->Requests();
+	CPPUNIT_ASSERT( ! cache.HasACL("user", "service", "read") );
+	CPPUNIT_ASSERT_EQUAL( reqs, standin->Requests() );
+
+	// Write through updates entry
+	CPPUNIT_ASSERT( cache.AddACL("user", "service", "read") );
+	reqs = standin->Requests();
+	CPPUNIT_ASSERT( cache.HasACL("user", "service", "read") );
+	CPPUNIT_ASSERT_EQUAL( reqs, standin->Requests() );
+
+	CPPUNIT_ASSERT_EQUAL( (size_t) 0, cache.GetGroupMembers("group").size() );
+	CPPUNIT_ASSERT( cache.AddGroupMember("group", "user") );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1, cache.GetGroupMembers("group").size() );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 1, cache.GetUserGroups("user").size() );
+
+	// Changes not made through cache are seen after flush
+	CPPUNIT_ASSERT( cache.HasACL("user", "service", "read") );
+	pool.Get()->RemoveACL("user", "service", "read");
+	CPPUNIT_ASSERT( cache.HasACL("user", "service", "read") );
+	cache.Flush();
+	CPPUNIT_ASSERT( ! cache.HasACL("user", "service", "read") );
+
+	// Removing a service drops all its cached acls
+	CPPUNIT_ASSERT( cache.AddACL("user", "service", "write") );
+	CPPUNIT_ASSERT( cache.HasACL("user", "service", "write") );
+	CPPUNIT_ASSERT( cache.RemoveService("user", "service") );
+	pool.Get()->AddService("user", "service");
+	CPPUNIT_ASSERT( ! cache.HasACL("user", "service", "write") );
+
+	// Failed user removal leaves group members as they are
+	pool.Get()->AddGroupMember("group", "nouser");
+	cache.Flush();
+	CPPUNIT_ASSERT_EQUAL( (size_t) 2, cache.GetGroupMembers("group").size() );
+	CPPUNIT_ASSERT( ! cache.RemoveUser("nouser") );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 2, cache.GetGroupMembers("group").size() );
+}
+
+void TestSecop::TestAsync()
+{
+	AsyncSecop as( TESTSOCKET );
+
+	CPPUNIT_ASSERT( as.SockAuth().get() );
+
+	Json::Value cmd(Json::objectValue);
+	cmd["cmd"] = "createuser";
+	cmd["username"] = "user";
+	cmd["password"] = "secret";
+	as.Call( cmd ).get();
+
+	cmd = Json::objectValue;
+	cmd["cmd"] = "groupadd";
+	cmd["group"] = "group";
+	as.Call( cmd ).get();
+
+	list<future<vector<string>>> replies;
+	for( int i = 0; i < 100; i++ )
+	{
+		replies.push_back( as.GetUserGroups("user") );
+	}
+
+	for( auto& reply: replies )
+	{
+		CPPUNIT_ASSERT_EQUAL( (size_t) 0, reply.get().size() );
+	}
+
+	CPPUNIT_ASSERT_EQUAL( (size_t) 0, as.Pending() );
+
+	future<bool> bad = as.HasACL("nouser", "service", "acl");
+	CPPUNIT_ASSERT_THROW( bad.get(), runtime_error );
+}
+
+void TestSecop::TestMetrics()
+{
+	Secop s( TESTSOCKET );
+	s.SockAuth();
+	s.CreateUser("user", "secret");
+
+	// Nothing recorded unless enabled
+	Secop::ResetMetrics();
+	s.GetUsers();
+	CPPUNIT_ASSERT( Secop::MetricsSnapshot().empty() );
+
+	Secop::EnableMetrics( true );
+	for( int i = 0; i < 10; i++ )
+	{
+		s.GetUsers();
+	}
+	CPPUNIT_ASSERT_THROW( s.GetServices("nouser"), runtime_error );
+
+	Secop::Batch b( s );
+	b.AddService("user", "service");
+	b.AddACL("user", "service", "acl");
+	b.Execute();
+	Secop::EnableMetrics( false );
+
+	map<string, Secop::CommandMetrics> m = Secop::MetricsSnapshot();
+	CPPUNIT_ASSERT( m.find("getusers") != m.end() );
+	CPPUNIT_ASSERT_EQUAL( (uint64_t) 10, m["getusers"].calls );
+	CPPUNIT_ASSERT_EQUAL( (uint64_t) 0, m["getusers"].errors );
+	CPPUNIT_ASSERT( m["getusers"].request_bytes > 0 );
+	CPPUNIT_ASSERT( m["getusers"].reply_bytes > 0 );
+
+	uint64_t hist = 0;
+	for( size_t i = 0; i < Secop::MetricsBuckets; i++ )
+	{
+		hist += m["getusers"].histogram[i];
+	}
+	CPPUNIT_ASSERT_EQUAL( (uint64_t) 10, hist );
+	CPPUNIT_ASSERT( m["getusers"].Percentile( 50 ) <= m["getusers"].max_usecs );
+
+	CPPUNIT_ASSERT_EQUAL( (uint64_t) 1, m["getservices"].errors );
+	CPPUNIT_ASSERT_EQUAL( (uint64_t) 1, m["addservice"].calls );
+	CPPUNIT_ASSERT_EQUAL( (uint64_t) 1, m["addacl"].calls );
+
+	Json::Value j = Secop::MetricsAsJson();
+	CPPUNIT_ASSERT_EQUAL( 10u, j["getusers"]["calls"].asUInt() );
+	CPPUNIT_ASSERT_EQUAL( Secop::MetricsBuckets, (size_t) j["getusers"]["histogram"].size() );
+
+	Secop::ResetMetrics();
+	CPPUNIT_ASSERT( Secop::MetricsSnapshot().empty() );
+}
+
+void TestSecop::TestBulk()
+{
+	Secop s( TESTSOCKET );
+	s.SockAuth();
+
+	vector<string> users;
+	for( int i = 0; i < 20; i++ )
+	{
+		string user = "user" + to_string(i);
+		s.CreateUser( user, "secret" );
+		s.AddService( user, "service" );
+		s.AddIdentifier( user, "service", { {"user", user}, {"id", to_string(i)} } );
+		s.AddAttribute( user, "email", user + "@example.com" );
+		if( i % 2 )
+		{
+			s.AddIdentifier( user, "service", { {"user", user}, {"id", "odd"} } );
+			s.AddAttribute( user, "name", "Odd " + to_string(i) );
+		}
+		users.push_back( user );
+	}
+	users.push_back( "nouser" );
+
+	Secop::FlatResult ids = s.GetIdentifiers( users, "service" );
+	CPPUNIT_ASSERT_EQUAL( users.size(), ids.Users().size() );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 60, ids.Size() );
+	CPPUNIT_ASSERT( ! ids.Ok( 20 ) );
+	CPPUNIT_ASSERT( ids.Range( 20 ).first == ids.Range( 20 ).second );
+
+	for( size_t u = 0; u < 20; u++ )
+	{
+		CPPUNIT_ASSERT( ids.Ok( u ) );
+		pair<size_t, size_t> r = ids.Range( u );
+		CPPUNIT_ASSERT_EQUAL( (size_t) ( u % 2 ? 4 : 2 ), r.second - r.first );
+		for( size_t i = r.first; i < r.second; i++ )
+		{
+			CPPUNIT_ASSERT_EQUAL( (uint32_t) u, ids[i].user );
+			if( ids.Key( i ) == "user" )
+			{
+				CPPUNIT_ASSERT_EQUAL( users[u], ids.Value( i ) );
+			}
+		}
+	}
+
+	Secop::FlatResult attrs = s.GetAttributes( users );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 30, attrs.Size() );
+	CPPUNIT_ASSERT( ! attrs.Ok( 20 ) );
+
+	pair<size_t, size_t> r = attrs.Range( 3 );
+	CPPUNIT_ASSERT_EQUAL( (size_t) 2, r.second - r.first );
+	for( size_t i = r.first; i < r.second; i++ )
+	{
+		CPPUNIT_ASSERT_EQUAL( s.GetAttribute( "user3", attrs.Key( i ) ), attrs.Value( i ) );
+	}
+
+	// Connection still usable for single calls
+	CPPUNIT_ASSERT_EQUAL( (size_t) 2, s.GetIdentifiers( "user1", "service" ).size() );
+}
@@ -0,0 +1,33 @@
+#ifndef TESTSECOP_H_
+#define TESTSECOP_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestSecop: public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE( TestSecop );
+	CPPUNIT_TEST( Test );
+	CPPUNIT_TEST( TestBatch );
+	CPPUNIT_TEST( TestLargeReply );
+	CPPUNIT_TEST( TestEncoding );
+	CPPUNIT_TEST( TestPool );
+	CPPUNIT_TEST( TestCache );
+	CPPUNIT_TEST( TestAsync );
+	CPPUNIT_TEST( TestMetrics );
+	CPPUNIT_TEST( TestBulk );
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void setUp();
+	void tearDown();
+	void Test();
+	void TestBatch();
+	void TestLargeReply();
+	void TestEncoding();
+	void TestPool();
+	void TestCache();
+	void TestAsync();
+	void TestMetrics();
+	void TestBulk();
+};
+
+#endif /* TESTSECOP_H_ */